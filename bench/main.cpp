@@ -0,0 +1,605 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <filesystem>
+#include <random>
+
+#include "../lab7/zlib/zlib.h"
+#include "../common/atomic_file.h"
+#include "../common/pnm_io.h"
+#include "../common/parallel.h"
+#include "../lab1/ppm_image.h"
+#include "../lab2/pnm_image.h"
+#include "../lab3/pgm_image.h"
+#include "../lab4/pnm_image.h"
+#include "../lab5/pgm_image.h"
+#include "../lab7/pnm_image.h"
+#include "../lab8/pnm_image.h"
+
+// Times every kernel of the labs on deterministic synthetic images and prints
+// the results as JSON. Kernels run in memory, only the PNG and JPEG decoders
+// read their (generated) input from a temporary file, as they only have a
+// constructor from a file.
+
+namespace fs = std::filesystem;
+
+struct bench_options {
+	std::vector<double> sizes = {0.25, 1, 4, 16, 100};
+	std::vector<std::string> labs = {"lab1", "lab2", "lab3", "lab4", "lab5", "lab7", "lab8"};
+	size_t repeats = 3;
+	size_t threads = 0;
+	std::string output;
+	fs::path temp_dir = fs::temp_directory_path();
+};
+
+struct bench_result {
+	std::string lab, kernel, format;
+	uint32_t w, h;
+	size_t bytes;
+	double seconds;
+	std::string error;
+};
+
+// xorshift32, the same sequence on every platform.
+struct random_source {
+	uint32_t state;
+
+	explicit random_source(uint32_t seed) : state(seed ? seed : 1) {}
+
+	uint32_t next() {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+};
+
+static pnm_header make_header(double megapixels, uint32_t type) {
+	pnm_header header;
+	header.type = type;
+	double pixels = megapixels * 1e6;
+	header.w = std::max(1u, static_cast<uint32_t>(round(sqrt(pixels * 4 / 3))));
+	header.h = std::max(1u, static_cast<uint32_t>(round(pixels / header.w)));
+	header.depth = 255;
+	return header;
+}
+
+// Smooth diagonal gradients with a different phase per channel plus a little
+// noise, so that neither flat regions nor pure noise dominate the timings.
+static std::unique_ptr<uint8_t[]> make_pixels(pnm_header const& header, uint32_t seed) {
+	std::unique_ptr<uint8_t[]> pixels;
+	try {
+		pixels = std::unique_ptr<uint8_t[]>(new uint8_t[header.length()]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	random_source random(seed);
+	uint8_t* cur = pixels.get();
+	for (size_t y = 0; y < header.h; y++) {
+		for (size_t x = 0; x < header.w; x++) {
+			for (size_t k = 0; k < header.type; k++) {
+				int value = static_cast<int>((x * 255 / header.w + y * 255 / header.h) / 2 + k * 85) % 256;
+				value += static_cast<int>(random.next() % 33) - 16;
+				*cur++ = static_cast<uint8_t>(std::min(255, std::max(0, value)));
+			}
+		}
+	}
+	return pixels;
+}
+
+static std::unique_ptr<uint8_t[]> copy_pixels(pnm_header const& header, uint8_t const* pixels) {
+	std::unique_ptr<uint8_t[]> copy;
+	try {
+		copy = std::unique_ptr<uint8_t[]>(new uint8_t[header.length()]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	memcpy(copy.get(), pixels, header.length());
+	return copy;
+}
+
+static void write_file(fs::path const& filename, std::vector<uint8_t> const& bytes) {
+	atomic_file output(filename.string());
+	output.write(bytes.data(), bytes.size());
+	output.commit();
+}
+
+static void put_be(std::vector<uint8_t>& bytes, uint32_t value, size_t size) {
+	for (size_t i = size; i > 0; i--) {
+		bytes.push_back(static_cast<uint8_t>(value >> (8 * (i - 1))));
+	}
+}
+
+static void put_png_chunk(std::vector<uint8_t>& png, char const* type, uint8_t const* data, size_t length) {
+	put_be(png, length, 4);
+	size_t start = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data, data + length);
+	put_be(png, crc32(0, png.data() + start, length + 4), 4);
+}
+
+static uint8_t paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
+// Grayscale or truecolor 8-bit PNG, the filter type cycles through 0..4 row by
+// row so that the decoder goes through all of its reconstruction paths.
+static std::vector<uint8_t> make_png(pnm_header const& header, uint8_t const* pixels) {
+	size_t row_size = static_cast<size_t>(header.w) * header.type;
+	std::vector<uint8_t> filtered((row_size + 1) * header.h);
+	std::vector<uint8_t> zero_row(row_size, 0);
+	for (size_t y = 0; y < header.h; y++) {
+		uint8_t const* row = pixels + y * row_size;
+		uint8_t const* prev = (y == 0 ? zero_row.data() : row - row_size);
+		uint8_t* out = filtered.data() + y * (row_size + 1);
+		uint8_t filter = y % 5;
+		*out++ = filter;
+		for (size_t i = 0; i < row_size; i++) {
+			int a = (i >= header.type ? row[i - header.type] : 0);
+			int b = prev[i];
+			int c = (i >= header.type ? prev[i - header.type] : 0);
+			switch (filter) {
+			case 0:
+				out[i] = row[i];
+				break;
+			case 1:
+				out[i] = row[i] - a;
+				break;
+			case 2:
+				out[i] = row[i] - b;
+				break;
+			case 3:
+				out[i] = row[i] - (a + b) / 2;
+				break;
+			case 4:
+				out[i] = row[i] - paeth(a, b, c);
+				break;
+			}
+		}
+	}
+	uLongf compressed_size = compressBound(filtered.size());
+	std::vector<uint8_t> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, filtered.data(), filtered.size(), 6) != Z_OK) {
+		throw std::runtime_error("Could not deflate");
+	}
+	std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	std::vector<uint8_t> ihdr;
+	put_be(ihdr, header.w, 4);
+	put_be(ihdr, header.h, 4);
+	ihdr.push_back(8);
+	ihdr.push_back(header.type == 1 ? 0 : 2);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	ihdr.push_back(0);
+	put_png_chunk(png, "IHDR", ihdr.data(), ihdr.size());
+	size_t const chunk_size = 1 << 16;
+	for (size_t i = 0; i < compressed_size; i += chunk_size) {
+		put_png_chunk(png, "IDAT", compressed.data() + i, std::min(chunk_size, compressed_size - i));
+	}
+	put_png_chunk(png, "IEND", nullptr, 0);
+	return png;
+}
+
+struct bit_writer {
+	std::vector<uint8_t>& bytes;
+	uint32_t cur = 0;
+	size_t count = 0;
+
+	explicit bit_writer(std::vector<uint8_t>& bytes) : bytes(bytes) {}
+
+	void put(uint32_t code, size_t length) {
+		for (size_t i = length; i > 0; i--) {
+			cur = 2 * cur + ((code >> (i - 1)) & 1);
+			if (++count == 8) {
+				bytes.push_back(cur);
+				if (cur == 0xff) bytes.push_back(0);
+				cur = 0;
+				count = 0;
+			}
+		}
+	}
+
+	void finish() {
+		while (count != 0) put(1, 1);
+	}
+};
+
+struct huffman_code {
+	uint16_t code[256] = {};
+	uint8_t length[256] = {};
+
+	huffman_code(uint8_t const (&bits)[16], uint8_t const* values) {
+		uint16_t cur = 0;
+		for (size_t i = 0, k = 0; i < 16; i++) {
+			for (size_t j = 0; j < bits[i]; j++, k++) {
+				code[values[k]] = cur++;
+				length[values[k]] = i + 1;
+			}
+			cur *= 2;
+		}
+	}
+
+	void put(bit_writer& writer, uint8_t symbol) const {
+		writer.put(code[symbol], length[symbol]);
+	}
+};
+
+static size_t magnitude_bits(int32_t value) {
+	size_t bits = 0;
+	for (uint32_t v = abs(value); v != 0; v /= 2) bits++;
+	return bits;
+}
+
+static void put_magnitude(bit_writer& writer, int32_t value, size_t bits) {
+	writer.put(value < 0 ? value + (1 << bits) - 1 : value, bits);
+}
+
+// Baseline grayscale JPEG in the subset lab8 decodes: one DQT, SOF0 with a
+// single component, one DC and one AC table. DC follows the block means of the
+// picture, a few small AC coefficients keep the AC decoding path busy.
+static std::vector<uint8_t> make_jpeg(pnm_header const& header, uint8_t const* pixels, uint32_t seed) {
+	uint8_t const dc_bits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+	uint8_t const dc_values[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+	uint8_t const ac_bits[16] = {0, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	uint8_t const ac_values[4] = {0x01, 0x00, 0x02, 0x11};
+	uint8_t const quant = 4;
+	huffman_code dc_code(dc_bits, dc_values);
+	huffman_code ac_code(ac_bits, ac_values);
+	std::vector<uint8_t> jpeg = {0xff, 0xd8};
+	put_be(jpeg, 0xffdb, 2);
+	put_be(jpeg, 67, 2);
+	jpeg.push_back(0);
+	jpeg.insert(jpeg.end(), 64, quant);
+	put_be(jpeg, 0xffc0, 2);
+	put_be(jpeg, 11, 2);
+	jpeg.push_back(8);
+	put_be(jpeg, header.h, 2);
+	put_be(jpeg, header.w, 2);
+	jpeg.push_back(1);
+	jpeg.push_back(1);
+	jpeg.push_back(0x11);
+	jpeg.push_back(0);
+	put_be(jpeg, 0xffc4, 2);
+	put_be(jpeg, 2 + 1 + 16 + sizeof(dc_values), 2);
+	jpeg.push_back(0x00);
+	jpeg.insert(jpeg.end(), dc_bits, dc_bits + 16);
+	jpeg.insert(jpeg.end(), dc_values, dc_values + sizeof(dc_values));
+	put_be(jpeg, 0xffc4, 2);
+	put_be(jpeg, 2 + 1 + 16 + sizeof(ac_values), 2);
+	jpeg.push_back(0x10);
+	jpeg.insert(jpeg.end(), ac_bits, ac_bits + 16);
+	jpeg.insert(jpeg.end(), ac_values, ac_values + sizeof(ac_values));
+	put_be(jpeg, 0xffda, 2);
+	put_be(jpeg, 8, 2);
+	jpeg.push_back(1);
+	jpeg.push_back(1);
+	jpeg.push_back(0x00);
+	jpeg.push_back(0);
+	jpeg.push_back(63);
+	jpeg.push_back(0);
+	bit_writer writer(jpeg);
+	random_source random(seed);
+	int32_t previous = 0;
+	for (size_t by = 0; by * 8 < header.h; by++) {
+		for (size_t bx = 0; bx * 8 < header.w; bx++) {
+			uint32_t sum = 0, count = 0;
+			for (size_t y = 8 * by; y < std::min<size_t>(header.h, 8 * by + 8); y++) {
+				for (size_t x = 8 * bx; x < std::min<size_t>(header.w, 8 * bx + 8); x++) {
+					sum += pixels[y * header.w + x];
+					count++;
+				}
+			}
+			int32_t dc = static_cast<int32_t>(round(8.0 * (static_cast<double>(sum) / count - 128) / quant));
+			// lab8 does not handle a zero DC difference (category 0).
+			if (dc == previous) dc += (dc < 0 ? 1 : -1);
+			size_t bits = magnitude_bits(dc - previous);
+			dc_code.put(writer, bits);
+			put_magnitude(writer, dc - previous, bits);
+			previous = dc;
+			for (size_t i = random.next() % 4; i > 0; i--) {
+				uint32_t r = random.next();
+				uint8_t symbol = ac_values[r % 4 == 1 ? 0 : r % 4];
+				int32_t value = (symbol == 0x02 ? 2 + (r >> 8) % 2 : 1);
+				if ((r >> 16) % 2) value = -value;
+				ac_code.put(writer, symbol);
+				put_magnitude(writer, value, symbol % 16);
+			}
+			ac_code.put(writer, 0x00);
+		}
+	}
+	writer.finish();
+	put_be(jpeg, 0xffd9, 2);
+	return jpeg;
+}
+
+template<typename Prepare, typename Run>
+static double best_time(size_t repeats, Prepare const& prepare, Run const& run) {
+	double best = std::numeric_limits<double>::infinity();
+	for (size_t i = 0; i < repeats; i++) {
+		auto state = prepare();
+		auto start = std::chrono::steady_clock::now();
+		run(state);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+struct bench_runner {
+	bench_options const& options;
+	std::vector<bench_result> results;
+
+	template<typename Prepare, typename Run>
+	void measure(std::string const& lab, std::string const& kernel, pnm_header const& header,
+		Prepare const& prepare, Run const& run) {
+		bench_result result;
+		result.lab = lab;
+		result.kernel = kernel;
+		result.format = (header.type == 1 ? "P5" : "P6");
+		result.w = header.w;
+		result.h = header.h;
+		result.bytes = header.length();
+		result.seconds = 0;
+		try {
+			result.seconds = best_time(options.repeats, prepare, run);
+		} catch (std::exception const& e) {
+			result.error = e.what();
+		}
+		std::cerr << lab << " " << kernel << " " << result.format << " " << header.w << "x" << header.h << ": ";
+		if (result.error.empty()) {
+			std::cerr << result.seconds << " s" << std::endl;
+		} else {
+			std::cerr << result.error << std::endl;
+		}
+		results.push_back(result);
+	}
+
+	bool enabled(std::string const& lab) const {
+		return std::find(options.labs.begin(), options.labs.end(), lab) != options.labs.end();
+	}
+
+	void run_lab1(pnm_header const& header, uint8_t const* pixels) {
+		char const* names[] = {"invert", "flip_horizontally", "flip_vertically", "rotate_90_clockwise", "rotate_90_counter_clockwise"};
+		for (char operation = '0'; operation <= '4'; operation++) {
+			for (bool in_place : {false, true}) {
+				if (in_place && operation < '3') continue;
+				std::string name = names[operation - '0'];
+				measure("lab1", in_place ? name + "_in_place" : name, header,
+					[&]() { return std::make_unique<lab1::ppm_image>(header, copy_pixels(header, pixels)); },
+					[&](std::unique_ptr<lab1::ppm_image>& image) {
+						image->set_in_place(in_place);
+						image->set_threads(options.threads);
+						lab1::orientation operations;
+						operations.apply(operation);
+						image->orient(operations);
+						image->apply();
+					});
+			}
+		}
+	}
+
+	void run_lab2(pnm_header const& header, uint8_t const* pixels) {
+		char const* models[] = {"RGB", "HSL", "HSV", "YCbCr.601", "YCbCr.709", "YCoCg", "CMY"};
+		for (std::string model : models) {
+			// RGB->RGB would be measured twice.
+			if (model == "RGB") continue;
+			for (bool to_rgb : {false, true}) {
+				std::string from = (to_rgb ? model : "RGB");
+				std::string to = (to_rgb ? "RGB" : model);
+				measure("lab2", from + "->" + to, header,
+					[&]() { return std::make_unique<lab2::pnm_image>(header, copy_pixels(header, pixels), from); },
+					[&](std::unique_ptr<lab2::pnm_image>& image) { image->convert(to); });
+			}
+		}
+	}
+
+	void run_lab3(pnm_header const& header, uint8_t const* pixels) {
+		char const* names[] = {"no", "ordered", "random", "floyd_steinberg", "jarvis_judice_ninke", "sierra", "atkinson", "halftone",
+			"stucki", "burkes", "sierra_lite", "blue_noise"};
+		for (uint8_t type = 0; type < lab3::num_dither_types; type++) {
+			measure("lab3", names[type], header,
+				[&]() { return std::make_unique<lab3::pgm_image>(header, pixels); },
+				[&](std::unique_ptr<lab3::pgm_image>& image) { image->dither(type, 1, 0); });
+		}
+	}
+
+	void run_lab4(pnm_header const& header, uint8_t const* pixels) {
+		char const* names[] = {"nearest_neighbor", "bilinear", "lanczos3", "bc_spline"};
+		uint32_t new_w = std::max(1u, header.w / 2);
+		uint32_t new_h = std::max(1u, header.h / 2);
+		for (char scale = '0'; scale <= '3'; scale++) {
+			measure("lab4", names[scale - '0'], header,
+				[&]() { return std::make_unique<lab4::pnm_image>(header, pixels); },
+				[&](std::unique_ptr<lab4::pnm_image>& image) { image->convert(new_w, new_h, 0, 0, 0, scale, 0, 0.5); });
+		}
+	}
+
+	void run_lab5(pnm_header const& header, uint8_t const* pixels) {
+		for (uint32_t classes = 1; classes <= 4; classes++) {
+			measure("lab5", "otsu_" + std::to_string(classes), header,
+				[&]() { return std::make_unique<lab5::pgm_image>(header, copy_pixels(header, pixels)); },
+				[&](std::unique_ptr<lab5::pgm_image>& image) { image->divide_into_classes(classes); });
+		}
+	}
+
+	template<typename Decoder>
+	void run_decoder(std::string const& lab, std::string const& kernel, pnm_header const& header,
+		std::vector<uint8_t> const& encoded, std::string const& extension) {
+		// Written once, before the first run, so that a failure is reported
+		// for this kernel only. The name is random so that other users of the
+		// temporary directory cannot guess it.
+		fs::path filename;
+		measure(lab, kernel, header,
+			[&]() {
+				if (filename.empty()) {
+					fs::path name = options.temp_dir / ("bench_" + lab + "_" + std::to_string(header.w) + "x" + std::to_string(header.h)
+						+ "_" + std::to_string(std::random_device()()) + extension);
+					write_file(name, encoded);
+					filename = name;
+				}
+				return 0;
+			},
+			[&](int) { Decoder image(filename.string()); });
+		std::error_code error;
+		if (!filename.empty()) fs::remove(filename, error);
+	}
+
+	void run(double megapixels) {
+		pnm_header gray = make_header(megapixels, 1);
+		pnm_header color = make_header(megapixels, 3);
+		std::unique_ptr<uint8_t[]> gray_pixels = make_pixels(gray, 1);
+		std::unique_ptr<uint8_t[]> color_pixels = make_pixels(color, 3);
+		if (enabled("lab1")) {
+			run_lab1(gray, gray_pixels.get());
+			run_lab1(color, color_pixels.get());
+		}
+		if (enabled("lab2")) run_lab2(color, color_pixels.get());
+		if (enabled("lab3")) run_lab3(gray, gray_pixels.get());
+		if (enabled("lab4")) {
+			run_lab4(gray, gray_pixels.get());
+			run_lab4(color, color_pixels.get());
+		}
+		if (enabled("lab5")) run_lab5(gray, gray_pixels.get());
+		if (enabled("lab7")) {
+			run_decoder<lab7::pnm_image>("lab7", "png_decode", gray, make_png(gray, gray_pixels.get()), ".png");
+			run_decoder<lab7::pnm_image>("lab7", "png_decode", color, make_png(color, color_pixels.get()), ".png");
+		}
+		if (enabled("lab8") && gray.w <= 65535 && gray.h <= 65535) {
+			run_decoder<lab8::pnm_image>("lab8", "jpeg_decode", gray, make_jpeg(gray, gray_pixels.get(), 8), ".jpg");
+		}
+	}
+};
+
+// s as a JSON string literal, quotes included.
+static std::string json_string(std::string const& s) {
+	std::string escaped = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped + "\"";
+}
+
+static void print_json(std::ostream& output, bench_options const& options, std::vector<bench_result> const& results) {
+	output << "{\n  \"repeats\": " << options.repeats << ",\n  \"threads\": " << (options.threads == 0 ? default_threads() : options.threads)
+		<< ",\n  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		bench_result const& r = results[i];
+		double megapixels = static_cast<double>(r.w) * r.h / 1e6;
+		output << (i == 0 ? "\n" : ",\n");
+		output << "    {\"lab\": " << json_string(r.lab) << ", \"kernel\": " << json_string(r.kernel) << ", \"format\": " << json_string(r.format)
+			<< ", \"width\": " << r.w << ", \"height\": " << r.h << ", \"megapixels\": " << megapixels;
+		if (r.error.empty()) {
+			output << ", \"seconds\": " << r.seconds
+				<< ", \"mp_per_s\": " << (r.seconds > 0 ? megapixels / r.seconds : 0)
+				<< ", \"bytes_per_s\": " << (r.seconds > 0 ? r.bytes / r.seconds : 0) << "}";
+		} else {
+			output << ", \"error\": " << json_string(r.error) << "}";
+		}
+	}
+	output << "\n  ]\n}" << std::endl;
+}
+
+static std::vector<std::string> split(std::string const& arg) {
+	std::vector<std::string> parts;
+	std::stringstream stream(arg);
+	std::string part;
+	while (std::getline(stream, part, ',')) {
+		if (!part.empty()) parts.push_back(part);
+	}
+	return parts;
+}
+
+static bench_options parse_options(int argc, char* argv[]) {
+	bench_options options;
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 >= argc) throw std::runtime_error(std::string("Expected a value after ") + argv[i]);
+		std::string value = argv[i + 1];
+		if (strcmp(argv[i], "-s") == 0) {
+			options.sizes.clear();
+			for (std::string const& size : split(value)) {
+				try {
+					size_t index;
+					double megapixels = std::stod(size, &index);
+					if (index != size.size() || !(megapixels > 0)) throw std::runtime_error("");
+					options.sizes.push_back(megapixels);
+				} catch (...) {
+					throw std::runtime_error("Sizes should be positive numbers of megapixels");
+				}
+			}
+			if (options.sizes.empty()) throw std::runtime_error("Sizes should be positive numbers of megapixels");
+		} else if (strcmp(argv[i], "-l") == 0) {
+			options.labs = split(value);
+		} else if (strcmp(argv[i], "-r") == 0) {
+			try {
+				size_t index;
+				if (value[0] == '-') throw std::runtime_error("");
+				options.repeats = std::stoull(value, &index);
+				if (options.repeats == 0 || index != value.size()) throw std::runtime_error("");
+			} catch (...) {
+				throw std::runtime_error("Number of repeats should be a positive integer");
+			}
+		} else if (strcmp(argv[i], "-j") == 0) {
+			options.threads = get_thread_count(value.c_str());
+		} else if (strcmp(argv[i], "-o") == 0) {
+			options.output = value;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			options.temp_dir = value;
+			if (!fs::is_directory(options.temp_dir)) throw std::runtime_error("Temporary directory does not exist");
+		} else {
+			throw std::runtime_error(std::string("Unknown option ") + argv[i]);
+		}
+	}
+	return options;
+}
+
+int main(int argc, char* argv[]) {
+	bench_options options;
+	try {
+		options = parse_options(argc, argv);
+	} catch (std::exception const& e) {
+		std::cerr << e.what() << std::endl;
+		std::cerr << "Input format: [-s <megapixels>[,<megapixels>...]] [-l <lab>[,<lab>...]] [-r <repeats>] [-j <threads>] [-o <json file>] [-t <temporary directory>]" << std::endl;
+		return 1;
+	}
+	try {
+		bench_runner runner{options, {}};
+		for (double megapixels : options.sizes) {
+			runner.run(megapixels);
+		}
+		if (options.output.empty()) {
+			print_json(std::cout, options, runner.results);
+		} else {
+			std::ofstream output(options.output);
+			if (!output.is_open()) throw std::runtime_error("Could not open file for writing");
+			print_json(output, options, runner.results);
+			if (output.fail()) throw std::runtime_error("Could not write to the file");
+		}
+	} catch (std::exception const& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "atomic_file.h"
+
+// Tried in turn until a name is free: the process, a counter and the time
+// tell apart writers of the same file.
+static std::string temporary_name(std::string const& filename) {
+	static std::atomic<uint64_t> counter(0);
+#ifdef _WIN32
+	uint64_t process = GetCurrentProcessId();
+#else
+	uint64_t process = static_cast<uint64_t>(getpid());
+#endif
+	uint64_t now = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+	return filename + "." + std::to_string(process) + "." + std::to_string(counter++) + "." + std::to_string(now % 1000000) + ".tmp";
+}
+
+static size_t const max_attempts = 100;
+
+atomic_file::atomic_file(std::string const& filename) : target(filename) {
+	for (size_t attempt = 0; attempt < max_attempts; attempt++) {
+		temporary = temporary_name(filename);
+#ifdef _WIN32
+		handle = CreateFileA(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle != INVALID_HANDLE_VALUE) return;
+		if (GetLastError() != ERROR_FILE_EXISTS) break;
+#else
+		fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0666);
+		if (fd >= 0) return;
+		if (errno != EEXIST) break;
+#endif
+	}
+	throw std::runtime_error("Could not open file for writing");
+}
+
+atomic_file::~atomic_file() {
+	if (pending) {
+		close_file();
+		std::remove(temporary.c_str());
+	}
+}
+
+void atomic_file::write(void const* data, size_t size) {
+	uint8_t const* cur = static_cast<uint8_t const*>(data);
+	while (size != 0) {
+#ifdef _WIN32
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1 << 30));
+		DWORD written;
+		if (!WriteFile(handle, cur, chunk, &written, nullptr)) fail();
+#else
+		ssize_t written = ::write(fd, cur, std::min<size_t>(size, 1 << 30));
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) fail();
+#endif
+		cur += written;
+		size -= written;
+	}
+}
+
+void atomic_file::commit() {
+	if (!pending) fail();
+#ifdef _WIN32
+	bool closed = CloseHandle(handle);
+	pending = false;
+	if (!closed || !MoveFileExA(temporary.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING)) fail();
+#else
+	bool closed = ::close(fd) == 0;
+	pending = false;
+	if (!closed || std::rename(temporary.c_str(), target.c_str()) != 0) fail();
+#endif
+}
+
+void atomic_file::close_file() {
+#ifdef _WIN32
+	CloseHandle(handle);
+#else
+	::close(fd);
+#endif
+	pending = false;
+}
+
+// Only the temporary file is ever removed, the target is never touched.
+void atomic_file::fail() {
+	if (pending) close_file();
+	std::remove(temporary.c_str());
+	throw std::runtime_error("Could not write to the file");
+}
+
+void save_table(std::string const& filename, char const (&magic)[8], uint8_t const* params, size_t num_params,
+	void const* table, size_t size) {
+	uint8_t header[table_header_size] = {};
+	memcpy(header, magic, sizeof(magic));
+	memcpy(header + sizeof(magic), params, num_params);
+	atomic_file output(filename);
+	output.write(header, table_header_size);
+	output.write(table, size);
+	output.commit();
+}
+
+uint8_t const* table_params(uint8_t const* data, size_t size, char const (&magic)[8]) {
+	if (size < table_header_size || memcmp(data, magic, sizeof(magic)) != 0) return nullptr;
+	return data + sizeof(magic);
+}
+
+uint8_t const* table_params(mapped_file const& file, char const (&magic)[8]) {
+	return table_params(file.data(), file.size(), magic);
+}
\ No newline at end of file
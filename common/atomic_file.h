@@ -0,0 +1,76 @@
+#ifndef ATOMIC_FILE_H
+#define ATOMIC_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <exception>
+
+#include "mapped_file.h"
+
+// Output that replaces filename only once it is complete. The data goes to a
+// new file with a unique name in the same directory, created exclusively and
+// without following symlinks, which commit() renames over filename. Until
+// then filename is untouched, so it may be the file being read or mapped.
+// Without commit() only the temporary file is removed.
+struct atomic_file {
+	explicit atomic_file(std::string const& filename);
+
+	atomic_file(atomic_file const&) = delete;
+
+	atomic_file& operator=(atomic_file const&) = delete;
+
+	~atomic_file();
+
+	void write(void const* data, size_t size);
+
+	void commit();
+
+private:
+	std::string target;
+	std::string temporary;
+#ifdef _WIN32
+	void* handle;
+#else
+	int fd;
+#endif
+	bool pending = true;
+
+	void close_file();
+
+	void fail();
+};
+
+// Tables cached on disk start with an 8-byte magic and up to 8 bytes of
+// parameters, the table itself starts at table_header_size.
+size_t const table_header_size = 16;
+
+void save_table(std::string const& filename, char const (&magic)[8], uint8_t const* params, size_t num_params,
+	void const* table, size_t size);
+
+// The parameters of a table written by save_table if the size bytes at data
+// start with its magic, nullptr otherwise.
+uint8_t const* table_params(uint8_t const* data, size_t size, char const (&magic)[8]);
+
+uint8_t const* table_params(mapped_file const& file, char const (&magic)[8]);
+
+// Maps the table cached in filename if it loads and matches() accepts it,
+// otherwise builds it and saves it there for the next run. A table that could
+// not be saved is still returned unless must_save is set.
+template<typename Table, typename Matches, typename Build>
+Table open_cached(std::string const& filename, Matches matches, Build build, bool must_save = true) {
+	try {
+		Table table(filename);
+		if (matches(table)) return table;
+	} catch (std::exception&) {
+	}
+	Table table = build();
+	try {
+		table.save(filename);
+	} catch (std::exception&) {
+		if (must_save) throw;
+	}
+	return table;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <set>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "batch.h"
+#include "parallel.h"
+
+namespace fs = std::filesystem;
+
+bool is_batch(int argc, char* argv[]) {
+	return argc > 1 && strcmp(argv[1], "--batch") == 0;
+}
+
+static std::vector<std::string> read_inputs(std::string const& source) {
+	std::vector<std::string> inputs;
+	std::error_code error;
+	if (fs::is_directory(source, error)) {
+		for (fs::directory_entry const& entry : fs::directory_iterator(source, error)) {
+			if (entry.is_regular_file(error)) inputs.push_back(entry.path().string());
+		}
+		if (error) throw std::runtime_error("Could not read input directory");
+		std::sort(inputs.begin(), inputs.end());
+	} else {
+		std::ifstream manifest(source);
+		if (manifest.fail()) throw std::runtime_error("Could not open manifest file");
+		std::string line;
+		while (std::getline(manifest, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (!line.empty()) inputs.push_back(line);
+		}
+	}
+	if (inputs.empty()) throw std::runtime_error("There are no input files in the batch");
+	return inputs;
+}
+
+batch_options parse_batch(int argc, char* argv[]) {
+	if (argc < 4) throw std::runtime_error("Batch format: --batch <manifest or directory> <output directory> [-j <threads>]");
+	batch_options options;
+	options.inputs = read_inputs(argv[2]);
+	options.output_dir = argv[3];
+	if (!fs::is_directory(options.output_dir)) throw std::runtime_error("Output directory does not exist");
+	options.threads = default_threads();
+	options.first_arg = 4;
+	if (argc > 5 && strcmp(argv[4], "-j") == 0) {
+		options.threads = get_thread_count(argv[5]);
+		options.first_arg = 6;
+	}
+	return options;
+}
+
+void group_channel_inputs(batch_options& options) {
+	std::vector<std::string> grouped;
+	std::set<std::string> seen;
+	for (std::string const& input : options.inputs) {
+		fs::path path(input);
+		std::string stem = path.stem().string();
+		std::string name = input;
+		if (stem.size() > 2 && stem[stem.size() - 2] == '_' && stem.back() >= '1' && stem.back() <= '3') {
+			name = (path.parent_path() / (stem.substr(0, stem.size() - 2) + path.extension().string())).string();
+		}
+		if (seen.insert(name).second) grouped.push_back(name);
+	}
+	options.inputs = grouped;
+}
+
+// Asks the OS to start reading the file in the background, so that the next
+// input is already in the page cache when a worker gets to it.
+static void prefetch(std::string const& filename) {
+#ifndef _WIN32
+	int input = open(filename.c_str(), O_RDONLY);
+	if (input < 0) return;
+	posix_fadvise(input, 0, 0, POSIX_FADV_WILLNEED);
+	close(input);
+#endif
+}
+
+size_t run_batch(batch_options const& options, std::string const& extension,
+	std::function<void(std::string const& input, std::string const& output)> const& process) {
+	std::vector<std::string> const& inputs = options.inputs;
+	std::vector<std::string> outputs;
+	std::set<std::string> taken;
+	for (std::string const& input : inputs) {
+		fs::path output = fs::path(options.output_dir) / fs::path(input).filename();
+		if (!extension.empty()) output.replace_extension(extension);
+		if (!taken.insert(output.string()).second) {
+			throw std::runtime_error("Two inputs of the batch are written to " + output.string());
+		}
+		outputs.push_back(output.string());
+	}
+	size_t threads = std::min(options.threads, inputs.size());
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> failed(0);
+	std::mutex log_mutex;
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next++) < inputs.size()) {
+			if (i + threads < inputs.size()) prefetch(inputs[i + threads]);
+			try {
+				process(inputs[i], outputs[i]);
+			} catch (std::exception const& e) {
+				failed++;
+				std::lock_guard<std::mutex> lock(log_mutex);
+				std::cerr << inputs[i] << ": " << e.what() << std::endl;
+			}
+		}
+	};
+	for (size_t i = 0; i < threads && i < inputs.size(); i++) prefetch(inputs[i]);
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < threads; i++) pool.emplace_back(worker);
+	worker();
+	for (std::thread& t : pool) t.join();
+	return failed;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+
+// Batch mode shared by all tools:
+//   <tool> --batch <manifest or directory> <output directory> [-j <threads>] <arguments of the tool>
+// A manifest lists one input file per line, a directory contributes all of its regular files.
+// Every output goes to the output directory under the name of its input file.
+struct batch_options {
+	std::vector<std::string> inputs;
+	std::string output_dir;
+	size_t threads = 1;
+	int first_arg = 0;
+};
+
+bool is_batch(int argc, char* argv[]);
+
+batch_options parse_batch(int argc, char* argv[]);
+
+// For tools that read an image from three files <name>_1<ext>, <name>_2<ext>
+// and <name>_3<ext>: every such file of the inputs is replaced by <name><ext>,
+// once for the three of them.
+void group_channel_inputs(batch_options& options);
+
+// Runs process(input, output) for every input on a pool of options.threads workers.
+// extension replaces the extension of the output name unless it is empty.
+// A failed file is reported to std::cerr and does not stop the rest of the batch.
+// Two inputs that would write the same output are rejected before anything runs.
+// Returns the number of failed files.
+size_t run_batch(batch_options const& options, std::string const& extension,
+	std::function<void(std::string const& input, std::string const& output)> const& process);
+
+#endif
\ No newline at end of file
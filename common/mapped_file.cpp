@@ -0,0 +1,81 @@
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapped_file.h"
+
+mapped_file::mapped_file(std::string const& filename) {
+#ifdef _WIN32
+	HANDLE input = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (input == INVALID_HANDLE_VALUE) throw std::runtime_error("Could not open input file");
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(input, &file_size)) {
+		CloseHandle(input);
+		throw std::runtime_error("Could not open input file");
+	}
+	length = static_cast<size_t>(file_size.QuadPart);
+	if (length == 0) {
+		CloseHandle(input);
+		throw std::runtime_error("Incorrect format of file");
+	}
+	HANDLE mapping = CreateFileMappingA(input, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(input);
+	if (mapping == nullptr) throw std::runtime_error("Could not map input file");
+	base = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	CloseHandle(mapping);
+	if (base == nullptr) throw std::runtime_error("Could not map input file");
+#else
+	int input = open(filename.c_str(), O_RDONLY);
+	if (input < 0) throw std::runtime_error("Could not open input file");
+	struct stat st;
+	if (fstat(input, &st) != 0) {
+		close(input);
+		throw std::runtime_error("Could not open input file");
+	}
+	length = static_cast<size_t>(st.st_size);
+	if (length == 0) {
+		close(input);
+		throw std::runtime_error("Incorrect format of file");
+	}
+	void* ptr = mmap(nullptr, length, PROT_READ, MAP_SHARED, input, 0);
+	close(input);
+	if (ptr == MAP_FAILED) throw std::runtime_error("Could not map input file");
+	base = static_cast<uint8_t*>(ptr);
+#endif
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+	: base(std::exchange(other.base, nullptr)), length(std::exchange(other.length, 0)) {}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+	if (this != &other) {
+		unmap();
+		base = std::exchange(other.base, nullptr);
+		length = std::exchange(other.length, 0);
+	}
+	return *this;
+}
+
+mapped_file::~mapped_file() {
+	unmap();
+}
+
+void mapped_file::unmap() {
+	if (base == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+#else
+	munmap(base, length);
+#endif
+	base = nullptr;
+	length = 0;
+}
\ No newline at end of file
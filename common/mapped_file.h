@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file mapped into memory, shared with the page
+// cache: data written once can be read back by later runs without a copy.
+struct mapped_file {
+	mapped_file() = default;
+
+	explicit mapped_file(std::string const& filename);
+
+	mapped_file(mapped_file const&) = delete;
+
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	mapped_file(mapped_file&& other) noexcept;
+
+	mapped_file& operator=(mapped_file&& other) noexcept;
+
+	~mapped_file();
+
+	uint8_t const* data() const {
+		return base;
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+private:
+	uint8_t* base = nullptr;
+	size_t length = 0;
+
+	void unmap();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+
+#include "parallel.h"
+
+static size_t const min_band_bytes = 1 << 18;
+
+size_t default_threads() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+size_t get_thread_count(char const* arg) {
+	try {
+		size_t index;
+		if (arg[0] == '-') throw std::runtime_error("");
+		size_t threads = std::stoull(arg, &index);
+		if (threads == 0 || arg[index] != '\0') throw std::runtime_error("");
+		return threads;
+	} catch (...) {
+		throw std::runtime_error("Number of threads should be a positive integer");
+	}
+}
+
+void parallel_bands(size_t count, size_t item_bytes, size_t threads,
+	std::function<void(size_t begin, size_t end)> const& f) {
+	if (threads == 0) threads = default_threads();
+	threads = std::min(threads, std::max<size_t>(1, count * item_bytes / min_band_bytes));
+	threads = std::min(threads, std::max<size_t>(1, count));
+	if (threads == 1) {
+		f(0, count);
+		return;
+	}
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto run = [&](size_t i) {
+		try {
+			f(count * i / threads, count * (i + 1) / threads);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!error) error = std::current_exception();
+		}
+	};
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < threads; i++) {
+		pool.emplace_back(run, i);
+	}
+	run(0);
+	for (std::thread& t : pool) t.join();
+	if (error) std::rethrow_exception(error);
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads used when the caller asks for 0: one per hardware thread.
+size_t default_threads();
+
+size_t get_thread_count(char const* arg);
+
+// Splits [0, count) into contiguous bands and runs f(begin, end) for every band,
+// one band per thread. Each item is item_bytes of work, small jobs get fewer
+// threads so that a band is never shorter than a few hundred kilobytes.
+// threads == 0 means default_threads(). The first exception thrown by a band
+// is rethrown after all of them have finished.
+void parallel_bands(size_t count, size_t item_bytes, size_t threads,
+	std::function<void(size_t begin, size_t end)> const& f);
+
+#endif
\ No newline at end of file
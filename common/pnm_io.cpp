@@ -0,0 +1,189 @@
+#include <fstream>
+#include <string>
+#include <cctype>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "pnm_io.h"
+
+static uint32_t get_number(uint8_t const*& cur, uint8_t const* end, char delimiter) {
+	uint8_t const* begin = cur;
+	uint64_t num = 0;
+	while (cur != end && *cur != delimiter) {
+		if (!std::isdigit(*cur)) throw std::runtime_error("Incorrect format of file");
+		num = num * 10 + (*cur - '0');
+		if (num > UINT32_MAX) throw std::runtime_error("Incorrect format of file");
+		cur++;
+	}
+	if (cur == begin || cur == end || num == 0) throw std::runtime_error("Incorrect format of file");
+	cur++;
+	return static_cast<uint32_t>(num);
+}
+
+static size_t parse_header(uint8_t const* buf, size_t size, pnm_header& header) {
+	uint8_t const* cur = buf;
+	uint8_t const* end = buf + size;
+	if (size < 3 || cur[0] != 'P' || (cur[1] != '5' && cur[1] != '6') || cur[2] != '\n') {
+		throw std::runtime_error("Incorrect format of file, expected P5 or P6");
+	}
+	header.type = (cur[1] == '5' ? 1 : 3);
+	cur += 3;
+	header.w = get_number(cur, end, ' ');
+	header.h = get_number(cur, end, '\n');
+	header.depth = get_number(cur, end, '\n');
+	return cur - buf;
+}
+
+pnm_file::pnm_file(std::string const& filename) {
+#ifdef _WIN32
+	HANDLE input = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (input == INVALID_HANDLE_VALUE) throw std::runtime_error("Could not open input file");
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(input, &file_size)) {
+		CloseHandle(input);
+		throw std::runtime_error("Could not open input file");
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+	if (size == 0) {
+		CloseHandle(input);
+		throw std::runtime_error("Incorrect format of file");
+	}
+	HANDLE mapping = CreateFileMappingA(input, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(input);
+	if (mapping == nullptr) throw std::runtime_error("Could not map input file");
+	base = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+	CloseHandle(mapping);
+	if (base == nullptr) throw std::runtime_error("Could not map input file");
+#else
+	int input = open(filename.c_str(), O_RDONLY);
+	if (input < 0) throw std::runtime_error("Could not open input file");
+	struct stat st;
+	if (fstat(input, &st) != 0) {
+		close(input);
+		throw std::runtime_error("Could not open input file");
+	}
+	size = static_cast<size_t>(st.st_size);
+	if (size == 0) {
+		close(input);
+		throw std::runtime_error("Incorrect format of file");
+	}
+	void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, input, 0);
+	close(input);
+	if (ptr == MAP_FAILED) throw std::runtime_error("Could not map input file");
+	base = static_cast<uint8_t*>(ptr);
+	madvise(base, size, MADV_SEQUENTIAL);
+#endif
+	try {
+		offset = parse_header(base, size, hdr);
+		if (size - offset != hdr.length()) throw std::runtime_error("Incorrect format of file");
+	} catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+pnm_file::pnm_file(pnm_file&& other) noexcept
+	: hdr(other.hdr), base(std::exchange(other.base, nullptr)), size(std::exchange(other.size, 0)), offset(std::exchange(other.offset, 0)) {}
+
+pnm_file& pnm_file::operator=(pnm_file&& other) noexcept {
+	if (this != &other) {
+		unmap();
+		hdr = other.hdr;
+		base = std::exchange(other.base, nullptr);
+		size = std::exchange(other.size, 0);
+		offset = std::exchange(other.offset, 0);
+	}
+	return *this;
+}
+
+pnm_file::~pnm_file() {
+	unmap();
+}
+
+void pnm_file::unmap() {
+	if (base == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+#else
+	munmap(base, size);
+#endif
+	base = nullptr;
+	size = 0;
+	offset = 0;
+}
+
+pnm_reader::pnm_reader(std::string const& filename) : input(filename, std::ios_base::binary) {
+	if (input.fail()) throw std::runtime_error("Could not open input file");
+	input.seekg(0, std::ios_base::end);
+	size_t size = static_cast<size_t>(input.tellg());
+	input.seekg(0, std::ios_base::beg);
+	uint8_t buf[1024];
+	size_t buf_size = std::min(size, sizeof(buf));
+	input.read(reinterpret_cast<char*>(buf), buf_size);
+	if (input.fail()) throw std::runtime_error("Incorrect format of file");
+	size_t offset = parse_header(buf, buf_size, hdr);
+	if (size - offset != hdr.length()) throw std::runtime_error("Incorrect format of file");
+	input.seekg(offset, std::ios_base::beg);
+	rows_left = hdr.h;
+}
+
+size_t pnm_reader::read_rows(uint8_t* buf, size_t rows) {
+	rows = std::min(rows, rows_left);
+	input.read(reinterpret_cast<char*>(buf), rows * hdr.w * hdr.type);
+	if (input.fail()) throw std::runtime_error("Incorrect format of file");
+	rows_left -= rows;
+	return rows;
+}
+
+static std::string header_text(pnm_header const& header) {
+	return std::string(header.type == 1 ? "P5\n" : "P6\n") + std::to_string(header.w) + " " + std::to_string(header.h) + "\n"
+		+ std::to_string(header.depth) + "\n";
+}
+
+pnm_writer::pnm_writer(std::string const& filename, pnm_header const& header)
+	: output(filename), hdr(header), rows_left(header.h) {
+	std::string text = header_text(hdr);
+	output.write(text.data(), text.size());
+}
+
+void pnm_writer::write_rows(uint8_t const* buf, size_t rows) {
+	if (rows > rows_left) throw std::runtime_error("Could not write to the file");
+	output.write(buf, rows * hdr.w * hdr.type);
+	rows_left -= rows;
+}
+
+void pnm_writer::close() {
+	if (rows_left != 0) throw std::runtime_error("Could not write to the file");
+	output.commit();
+}
+
+size_t get_band_rows(char const* arg) {
+	try {
+		size_t index;
+		if (arg[0] == '-') throw std::runtime_error("");
+		size_t rows = std::stoull(arg, &index);
+		if (rows == 0 || arg[index] != '\0') throw std::runtime_error("");
+		return rows;
+	} catch (...) {
+		throw std::runtime_error("Band height should be a positive integer");
+	}
+}
+
+void write_pnm(std::string const& filename, pnm_header const& header, uint8_t const* pixels) {
+	atomic_file output(filename);
+	std::string text = header_text(header);
+	output.write(text.data(), text.size());
+	output.write(pixels, header.length());
+	output.commit();
+}
\ No newline at end of file
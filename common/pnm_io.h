@@ -0,0 +1,104 @@
+#ifndef PNM_IO_H
+#define PNM_IO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fstream>
+
+#include "atomic_file.h"
+
+struct pnm_header {
+	uint32_t type = 0;
+	uint32_t w = 0, h = 0;
+	uint16_t depth = 0;
+
+	size_t length() const {
+		return static_cast<size_t>(w) * h * type;
+	}
+};
+
+// Zero-copy access to a P5/P6 file: the file is mapped into memory and the
+// header is parsed in place, so pixels() points straight into the mapping.
+// The mapping is private: writes through pixels() never reach the file and
+// only the pages that are actually written get copied.
+struct pnm_file {
+	pnm_file() = default;
+
+	explicit pnm_file(std::string const& filename);
+
+	pnm_file(pnm_file const&) = delete;
+
+	pnm_file& operator=(pnm_file const&) = delete;
+
+	pnm_file(pnm_file&& other) noexcept;
+
+	pnm_file& operator=(pnm_file&& other) noexcept;
+
+	~pnm_file();
+
+	pnm_header const& header() const {
+		return hdr;
+	}
+
+	uint8_t* pixels() const {
+		return base + offset;
+	}
+
+private:
+	pnm_header hdr;
+	uint8_t* base = nullptr;
+	size_t size = 0;
+	size_t offset = 0;
+
+	void unmap();
+};
+
+// Sequential band-by-band access for images that do not fit in memory:
+// only the rows passed to read_rows/write_rows are ever resident.
+struct pnm_reader {
+	explicit pnm_reader(std::string const& filename);
+
+	pnm_reader(pnm_reader const&) = delete;
+
+	pnm_reader& operator=(pnm_reader const&) = delete;
+
+	pnm_header const& header() const {
+		return hdr;
+	}
+
+	size_t read_rows(uint8_t* buf, size_t rows);
+
+private:
+	std::ifstream input;
+	pnm_header hdr;
+	size_t rows_left;
+};
+
+// The output replaces filename only once every row was written and close()
+// succeeded, so filename may be the file being read.
+struct pnm_writer {
+	pnm_writer(std::string const& filename, pnm_header const& header);
+
+	pnm_writer(pnm_writer const&) = delete;
+
+	pnm_writer& operator=(pnm_writer const&) = delete;
+
+	~pnm_writer() = default;
+
+	void write_rows(uint8_t const* buf, size_t rows);
+
+	void close();
+
+private:
+	atomic_file output;
+	pnm_header hdr;
+	size_t rows_left;
+};
+
+size_t get_band_rows(char const* arg);
+
+// Like pnm_writer, filename is only replaced by a complete file.
+void write_pnm(std::string const& filename, pnm_header const& header, uint8_t const* pixels);
+
+#endif
\ No newline at end of file
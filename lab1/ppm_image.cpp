@@ -0,0 +1,574 @@
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "../common/parallel.h"
+#include "ppm_image.h"
+
+namespace lab1 {
+
+void orientation::apply(char operation) {
+	switch (operation) {
+	case '0':
+		invert = !invert;
+		break;
+	case '1':
+		mirror_x = !mirror_x;
+		break;
+	case '2':
+		mirror_y = !mirror_y;
+		break;
+	case '3':
+	case '4':
+		// Transposing after a mirror turns it into the mirror along the other axis.
+		transpose = !transpose;
+		std::swap(mirror_x, mirror_y);
+		if (operation == '3') {
+			mirror_x = !mirror_x;
+		} else {
+			mirror_y = !mirror_y;
+		}
+		break;
+	}
+}
+
+bool orientation::is_identity() const {
+	return !transpose && !mirror_x && !mirror_y && !invert;
+}
+
+bool orientation::is_row_local() const {
+	return !transpose && !mirror_y;
+}
+
+// Inversion is a XOR with all ones, done a register (or a machine word) at a time.
+static void invert_rows(uint8_t* data, size_t length) {
+	size_t i = 0;
+#ifdef __SSE2__
+	__m128i const ones = _mm_set1_epi8(-1);
+	for (; i + 64 <= length; i += 64) {
+		__m128i* cur = reinterpret_cast<__m128i*>(data + i);
+		__m128i a = _mm_loadu_si128(cur);
+		__m128i b = _mm_loadu_si128(cur + 1);
+		__m128i c = _mm_loadu_si128(cur + 2);
+		__m128i d = _mm_loadu_si128(cur + 3);
+		_mm_storeu_si128(cur, _mm_xor_si128(a, ones));
+		_mm_storeu_si128(cur + 1, _mm_xor_si128(b, ones));
+		_mm_storeu_si128(cur + 2, _mm_xor_si128(c, ones));
+		_mm_storeu_si128(cur + 3, _mm_xor_si128(d, ones));
+	}
+#endif
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		word = ~word;
+		memcpy(data + i, &word, 8);
+	}
+	for (; i < length; i++) {
+		data[i] ^= 255;
+	}
+}
+
+// Rows are reversed from both ends at once, a register of pixels from each
+// end is reversed and stored at the other end.
+template<size_t N>
+static void reverse_row(uint8_t* row, size_t w);
+
+template<>
+void reverse_row<1>(uint8_t* row, size_t w) {
+	size_t x1 = 0;
+	size_t x2 = w;
+#ifdef __SSE2__
+	auto reverse = [](__m128i v) {
+		v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+		return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	};
+	while (x1 + 32 <= x2) {
+		__m128i left = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + x1));
+		__m128i right = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + x2 - 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(row + x1), reverse(right));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(row + x2 - 16), reverse(left));
+		x1 += 16;
+		x2 -= 16;
+	}
+#endif
+	std::reverse(row + x1, row + x2);
+}
+
+template<>
+void reverse_row<3>(uint8_t* row, size_t w) {
+	size_t x1 = 0;
+	size_t x2 = w;
+#ifdef __SSSE3__
+	// Five pixels per register, the sixteenth byte belongs to the next pixel
+	// inwards and is written back unchanged.
+	__m128i const to_left = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1);
+	__m128i const to_right = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+	__m128i const keep_last = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1);
+	__m128i const keep_first = _mm_setr_epi8(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	while (x1 + 11 <= x2) {
+		uint8_t* left_ptr = row + 3 * x1;
+		uint8_t* right_ptr = row + 3 * (x2 - 5) - 1;
+		__m128i left = _mm_loadu_si128(reinterpret_cast<__m128i const*>(left_ptr));
+		__m128i right = _mm_loadu_si128(reinterpret_cast<__m128i const*>(right_ptr));
+		__m128i new_left = _mm_or_si128(_mm_shuffle_epi8(right, to_left), _mm_and_si128(left, keep_last));
+		__m128i new_right = _mm_or_si128(_mm_shuffle_epi8(left, to_right), _mm_and_si128(right, keep_first));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(left_ptr), new_left);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(right_ptr), new_right);
+		x1 += 5;
+		x2 -= 5;
+	}
+#endif
+	while (x1 + 1 < x2) {
+		x2--;
+		std::swap_ranges(row + 3 * x1, row + 3 * x1 + 3, row + 3 * x2);
+		x1++;
+	}
+}
+
+static void orient_rows(uint8_t* data, size_t rows, size_t w, size_t type, orientation const& o) {
+	if (o.mirror_x) {
+		for (size_t y = 0; y < rows; y++) {
+			if (type == 1) {
+				reverse_row<1>(data + y * w, w);
+			} else {
+				reverse_row<3>(data + y * w * 3, w);
+			}
+		}
+	}
+	if (o.invert) invert_rows(data, rows * w * type);
+}
+
+// Every orientation that swaps the axes is a transpose followed by mirrors:
+// clockwise rotation is a transpose mirrored left to right, counter clockwise
+// one is a transpose mirrored top to bottom. The image is walked in
+// rotate_tile x rotate_tile pixel tiles so that the rows of both the source
+// and the destination tile stay in cache, and every tile is split into blocks
+// that are transposed in registers where possible. Inversion is applied to
+// the pixels on the way.
+size_t const rotate_tile = 64;
+
+template<size_t N>
+struct rotate_block;
+
+// Source row i of a block is read from y0 + i (or y0 + size - 1 - i when
+// mirroring left to right, which reverses the columns of the result), and its
+// transposed row j goes to destination row dst_row(j).
+struct rotate_geometry {
+	uint8_t const* src;
+	uint8_t* dst;
+	size_t w, h;
+	bool mirror_x, mirror_y;
+	uint8_t mask;
+
+	size_t src_row(size_t y0, size_t i, size_t size) const {
+		return mirror_x ? y0 + size - 1 - i : y0 + i;
+	}
+
+	size_t dst_row(size_t x0, size_t j) const {
+		return mirror_y ? w - 1 - x0 - j : x0 + j;
+	}
+
+	size_t dst_col(size_t y0, size_t size) const {
+		return mirror_x ? h - size - y0 : y0;
+	}
+};
+
+template<size_t N>
+static void rotate_scalar(rotate_geometry const& g, size_t x0, size_t x1, size_t y0, size_t y1) {
+	for (size_t x = x0; x < x1; x++) {
+		uint8_t* dst = g.dst + g.dst_row(x, 0) * g.h * N;
+		for (size_t y = y0; y < y1; y++) {
+			size_t col = (g.mirror_x ? g.h - 1 - y : y);
+			uint8_t const* src = g.src + (y * g.w + x) * N;
+			for (size_t k = 0; k < N; k++) {
+				dst[col * N + k] = src[k] ^ g.mask;
+			}
+		}
+	}
+}
+
+#ifdef __SSE2__
+// 16x16 bytes: four rounds of interleaving rows i and i + 8 transpose the block.
+template<>
+struct rotate_block<1> {
+	static size_t const size = 16;
+
+	static void run(rotate_geometry const& g, size_t x0, size_t y0) {
+		__m128i a[16], b[16];
+		for (size_t i = 0; i < 16; i++) {
+			a[i] = _mm_loadu_si128(reinterpret_cast<__m128i const*>(g.src + g.src_row(y0, i, 16) * g.w + x0));
+		}
+		for (size_t round = 0; round < 4; round++) {
+			for (size_t i = 0; i < 8; i++) {
+				b[2 * i] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+				b[2 * i + 1] = _mm_unpackhi_epi8(a[i], a[i + 8]);
+			}
+			std::copy(b, b + 16, a);
+		}
+		size_t col = g.dst_col(y0, 16);
+		__m128i mask = _mm_set1_epi8(g.mask);
+		for (size_t j = 0; j < 16; j++) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(g.dst + g.dst_row(x0, j) * g.h + col), _mm_xor_si128(a[j], mask));
+		}
+	}
+};
+#endif
+
+#ifdef __SSSE3__
+// 4x4 pixels of 3 bytes: pixels are widened to 32-bit lanes, transposed as
+// 32-bit elements and packed back.
+template<>
+struct rotate_block<3> {
+	static size_t const size = 4;
+
+	static __m128i load_row(uint8_t const* src) {
+		int32_t tail;
+		memcpy(&tail, src + 8, 4);
+		__m128i row = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(src)), _mm_cvtsi32_si128(tail));
+		return _mm_shuffle_epi8(row, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+	}
+
+	static void store_row(uint8_t* dst, __m128i row) {
+		row = _mm_shuffle_epi8(row, _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), row);
+		int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(row, 8));
+		memcpy(dst + 8, &tail, 4);
+	}
+
+	static void run(rotate_geometry const& g, size_t x0, size_t y0) {
+		__m128i r[4];
+		for (size_t i = 0; i < 4; i++) {
+			r[i] = load_row(g.src + (g.src_row(y0, i, 4) * g.w + x0) * 3);
+		}
+		__m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+		__m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+		__m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+		__m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+		r[0] = _mm_unpacklo_epi64(t0, t1);
+		r[1] = _mm_unpackhi_epi64(t0, t1);
+		r[2] = _mm_unpacklo_epi64(t2, t3);
+		r[3] = _mm_unpackhi_epi64(t2, t3);
+		size_t col = g.dst_col(y0, 4);
+		__m128i mask = _mm_set1_epi8(g.mask);
+		for (size_t j = 0; j < 4; j++) {
+			store_row(g.dst + (g.dst_row(x0, j) * g.h + col) * 3, _mm_xor_si128(r[j], mask));
+		}
+	}
+};
+#endif
+
+// Without a register kernel for the pixel size the blocks are copied pixel by pixel.
+template<size_t N>
+struct rotate_block {
+	static size_t const size = 8;
+
+	static void run(rotate_geometry const& g, size_t x0, size_t y0) {
+		rotate_scalar<N>(g, x0, x0 + size, y0, y0 + size);
+	}
+};
+
+// Bands are whole rows of tiles, so every thread writes its own columns of
+// the destination.
+template<size_t N>
+static void transpose_pixels(uint8_t const* src, uint8_t* dst, size_t w, size_t h, orientation const& o, size_t threads) {
+	rotate_geometry g = {src, dst, w, h, o.mirror_x, o.mirror_y, static_cast<uint8_t>(o.invert ? 255 : 0)};
+	size_t const block = rotate_block<N>::size;
+	size_t full_w = w - w % block;
+	size_t full_h = h - h % block;
+	size_t tile_rows = (h + rotate_tile - 1) / rotate_tile;
+	parallel_bands(tile_rows, rotate_tile * w * N, threads, [&](size_t begin, size_t end) {
+		size_t y0 = begin * rotate_tile;
+		size_t y1 = std::min(end * rotate_tile, h);
+		for (size_t ty = y0; ty < std::min(y1, full_h); ty += rotate_tile) {
+			for (size_t tx = 0; tx < full_w; tx += rotate_tile) {
+				for (size_t y = ty; y < std::min(ty + rotate_tile, full_h); y += block) {
+					for (size_t x = tx; x < std::min(tx + rotate_tile, full_w); x += block) {
+						rotate_block<N>::run(g, x, y);
+					}
+				}
+			}
+		}
+		rotate_scalar<N>(g, full_w, w, y0, y1);
+		rotate_scalar<N>(g, 0, full_w, std::max(y0, full_h), y1);
+	});
+}
+
+// In place the pixels have to be moved along the cycles of the permutation.
+// On a square every rotation cycle has four pixels, one of them in the top
+// left quadrant, and every reflection cycle has two.
+template<size_t N>
+static void move_pixel(uint8_t* dst, uint8_t const* src, uint8_t mask) {
+	for (size_t k = 0; k < N; k++) {
+		dst[k] = src[k] ^ mask;
+	}
+}
+
+template<size_t N>
+static void transpose_square_in_place(uint8_t* data, size_t n, orientation const& o, size_t threads) {
+	uint8_t mask = (o.invert ? 255 : 0);
+	auto at = [&](size_t x, size_t y) { return data + (y * n + x) * N; };
+	auto next_x = [&](size_t, size_t y) { return o.mirror_x ? n - 1 - y : y; };
+	auto next_y = [&](size_t x, size_t) { return o.mirror_y ? n - 1 - x : x; };
+	if (o.mirror_x != o.mirror_y) {
+		size_t half_w = n / 2, half_h = (n + 1) / 2;
+		size_t tile_rows = (half_h + rotate_tile - 1) / rotate_tile;
+		parallel_bands(tile_rows, 4 * rotate_tile * half_w * N, threads, [&](size_t begin, size_t end) {
+			for (size_t ty = begin * rotate_tile; ty < std::min(end * rotate_tile, half_h); ty += rotate_tile) {
+				for (size_t tx = 0; tx < half_w; tx += rotate_tile) {
+					for (size_t y = ty; y < std::min(ty + rotate_tile, half_h); y++) {
+						for (size_t x = tx; x < std::min(tx + rotate_tile, half_w); x++) {
+							size_t bx = next_x(x, y), by = next_y(x, y);
+							size_t cx = next_x(bx, by), cy = next_y(bx, by);
+							size_t dx = next_x(cx, cy), dy = next_y(cx, cy);
+							uint8_t* a = at(x, y);
+							uint8_t* b = at(bx, by);
+							uint8_t* c = at(cx, cy);
+							uint8_t* d = at(dx, dy);
+							uint8_t last[N];
+							memcpy(last, d, N);
+							move_pixel<N>(d, c, mask);
+							move_pixel<N>(c, b, mask);
+							move_pixel<N>(b, a, mask);
+							move_pixel<N>(a, last, mask);
+						}
+					}
+				}
+			}
+		});
+		if (n % 2 == 1) move_pixel<N>(at(n / 2, n / 2), at(n / 2, n / 2), mask);
+	} else {
+		parallel_bands(n, n * N, threads, [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; y++) {
+				for (size_t x = 0; x < n; x++) {
+					size_t bx = next_x(x, y), by = next_y(x, y);
+					if (by * n + bx < y * n + x) continue;
+					uint8_t* a = at(x, y);
+					uint8_t* b = at(bx, by);
+					uint8_t first[N];
+					memcpy(first, a, N);
+					move_pixel<N>(a, b, mask);
+					if (a != b) move_pixel<N>(b, first, mask);
+				}
+			}
+		});
+	}
+}
+
+// Any other size: every position is filled from its source until the cycle
+// closes, a bit per pixel marks the positions already filled. The cycles
+// wander over the whole image, so this one stays on a single thread.
+template<size_t N>
+static void transpose_cycles_in_place(uint8_t* data, size_t w, size_t h, orientation const& o) {
+	uint8_t mask = (o.invert ? 255 : 0);
+	size_t length = w * h;
+	std::vector<uint64_t> done;
+	try {
+		done.resize((length + 63) / 64, 0);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	auto source = [&](size_t position) {
+		size_t x = position / h, y = position % h;
+		if (o.mirror_y) x = w - 1 - x;
+		if (o.mirror_x) y = h - 1 - y;
+		return y * w + x;
+	};
+	for (size_t start = 0; start < length; start++) {
+		if (done[start / 64] >> (start % 64) & 1) continue;
+		uint8_t first[N];
+		memcpy(first, data + start * N, N);
+		size_t cur = start;
+		while (true) {
+			done[cur / 64] |= uint64_t(1) << (cur % 64);
+			size_t next = source(cur);
+			if (next == start) {
+				move_pixel<N>(data + cur * N, first, mask);
+				break;
+			}
+			move_pixel<N>(data + cur * N, data + next * N, mask);
+			cur = next;
+		}
+	}
+}
+
+template<size_t N>
+static void transpose_in_place(uint8_t* data, size_t w, size_t h, orientation const& o, size_t threads) {
+	if (w == h) {
+		transpose_square_in_place<N>(data, w, o, threads);
+	} else {
+		transpose_cycles_in_place<N>(data, w, h, o);
+	}
+}
+
+ppm_image::ppm_image(char const* filename) : file(filename) {
+	pnm_header const& header = file.header();
+	type = header.type;
+	w = header.w;
+	h = header.h;
+	depth = header.depth;
+	data = file.pixels();
+}
+
+ppm_image::ppm_image(pnm_header const& header, std::unique_ptr<uint8_t[]> pixels)
+	: buffer(std::move(pixels)), type(header.type), w(header.w), h(header.h), depth(header.depth) {
+	data = buffer.get();
+}
+
+void ppm_image::print_to_file(char const* filename) {
+	apply();
+	write_pnm(filename, header(), data);
+}
+
+pnm_header ppm_image::header() const {
+	pnm_header header;
+	header.type = type;
+	header.w = (pending.transpose ? h : w);
+	header.h = (pending.transpose ? w : h);
+	header.depth = depth;
+	return header;
+}
+
+std::unique_ptr<uint8_t[]> ppm_image::release() {
+	apply();
+	if (!buffer) {
+		size_t length = static_cast<size_t>(w) * h * type;
+		try {
+			buffer = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+		} catch (...) {
+			throw std::runtime_error("Could not allocate memory");
+		}
+		memcpy(buffer.get(), data, length);
+		file = pnm_file();
+	}
+	data = nullptr;
+	return std::move(buffer);
+}
+
+void ppm_image::invert() {
+	pending.apply('0');
+}
+
+void ppm_image::flip_horizontally() {
+	pending.apply('1');
+}
+
+void ppm_image::flip_vertically() {
+	pending.apply('2');
+}
+
+void ppm_image::rotate_90_clockwise() {
+	pending.apply('3');
+}
+
+void ppm_image::rotate_90_counter_clockwise() {
+	pending.apply('4');
+}
+
+void ppm_image::set_in_place(bool enable) {
+	in_place = enable;
+}
+
+void ppm_image::set_threads(size_t count) {
+	threads = count;
+}
+
+void ppm_image::orient(orientation const& operations) {
+	if (operations.invert) pending.apply('0');
+	if (operations.transpose) {
+		pending.transpose = !pending.transpose;
+		std::swap(pending.mirror_x, pending.mirror_y);
+	}
+	if (operations.mirror_x) pending.apply('1');
+	if (operations.mirror_y) pending.apply('2');
+}
+
+void ppm_image::apply() {
+	orientation o = pending;
+	pending = orientation();
+	if (o.transpose && in_place) {
+		try {
+			if (type == 1) {
+				transpose_in_place<1>(data, w, h, o, threads);
+			} else {
+				transpose_in_place<3>(data, w, h, o, threads);
+			}
+		} catch (...) {
+			pending = o;
+			throw;
+		}
+		std::swap(w, h);
+	} else if (o.transpose) {
+		size_t length = static_cast<size_t>(w) * h * type;
+		std::unique_ptr<uint8_t[]> new_data;
+		try {
+			new_data = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+		} catch (...) {
+			pending = o;
+			throw std::runtime_error("Could not allocate memory");
+		}
+		if (type == 1) {
+			transpose_pixels<1>(data, new_data.get(), w, h, o, threads);
+		} else {
+			transpose_pixels<3>(data, new_data.get(), w, h, o, threads);
+		}
+		std::swap(w, h);
+		set_buffer(std::move(new_data));
+	} else if (o.mirror_y) {
+		size_t row_size = static_cast<size_t>(w) * type;
+		parallel_bands((h + 1) / 2, 2 * row_size, threads, [&](size_t begin, size_t end) {
+			for (size_t y1 = begin; y1 < end; y1++) {
+				size_t y2 = h - 1 - y1;
+				uint8_t* top = data + y1 * row_size;
+				uint8_t* bottom = data + y2 * row_size;
+				if (y1 != y2) std::swap_ranges(top, top + row_size, bottom);
+				orient_rows(top, 1, w, type, o);
+				if (y1 != y2) orient_rows(bottom, 1, w, type, o);
+			}
+		});
+	} else if (!o.is_identity()) {
+		size_t row_size = static_cast<size_t>(w) * type;
+		parallel_bands(h, row_size, threads, [&](size_t begin, size_t end) {
+			orient_rows(data + begin * row_size, end - begin, w, type, o);
+		});
+	}
+}
+
+void ppm_image::set_buffer(std::unique_ptr<uint8_t[]> new_data) {
+	buffer = std::move(new_data);
+	data = buffer.get();
+	file = pnm_file();
+}
+
+void ppm_image::stream(char const* input_filename, char const* output_filename, orientation const& operations, size_t band_rows) {
+	if (!operations.is_row_local()) throw std::runtime_error("Only operations 0 and 1 can be done by bands");
+	pnm_reader input(input_filename);
+	pnm_header const& header = input.header();
+	size_t row_size = static_cast<size_t>(header.w) * header.type;
+	band_rows = std::min<size_t>(band_rows, header.h);
+	std::unique_ptr<uint8_t[]> band;
+	try {
+		band = std::unique_ptr<uint8_t[]>(new uint8_t[band_rows * row_size]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	pnm_writer output(output_filename, header);
+	size_t rows;
+	while ((rows = input.read_rows(band.get(), band_rows)) != 0) {
+		orient_rows(band.get(), rows, header.w, header.type, operations);
+		output.write_rows(band.get(), rows);
+	}
+	output.close();
+}
+
+}
\ No newline at end of file
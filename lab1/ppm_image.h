@@ -0,0 +1,91 @@
+#ifndef LAB1_PPM_IMAGE_H
+#define LAB1_PPM_IMAGE_H
+
+#include <memory>
+#include <cstdint>
+#include <string>
+
+#include "../common/pnm_io.h"
+
+namespace lab1 {
+
+// A sequence of operations folded into one element of the symmetry group of
+// the rectangle: the image is transposed if transpose is set, then mirrored
+// left to right (mirror_x) and top to bottom (mirror_y). Inversion commutes
+// with all of them and is kept as a flag.
+struct orientation {
+	bool transpose = false;
+	bool mirror_x = false;
+	bool mirror_y = false;
+	bool invert = false;
+
+	// Composes the operation '0'..'4' after the ones already folded in.
+	void apply(char operation);
+
+	bool is_identity() const;
+
+	// Each output row is made from the same input row, so the image can be streamed.
+	bool is_row_local() const;
+};
+
+struct ppm_image {
+	explicit ppm_image(char const* filename);
+
+	ppm_image(pnm_header const& header, std::unique_ptr<uint8_t[]> pixels);
+
+	ppm_image(ppm_image const&) = delete;
+
+	ppm_image& operator=(ppm_image const&) = delete;
+
+	~ppm_image() = default;
+
+	void print_to_file(char const* filename);
+
+	pnm_header header() const;
+
+	std::unique_ptr<uint8_t[]> release();
+
+	// The operations below are only recorded, the pixels are transformed once
+	// by apply(), which print_to_file and release call.
+	void invert();
+
+	void flip_horizontally();
+
+	void flip_vertically();
+
+	void rotate_90_clockwise();
+
+	void rotate_90_counter_clockwise();
+
+	void orient(orientation const& operations);
+
+	// Rotations and transpositions are done without a second buffer: slower,
+	// but the peak memory stays at the size of the image.
+	void set_in_place(bool enable);
+
+	// Every operation is split into row bands over this many threads, 0 means
+	// one per hardware thread.
+	void set_threads(size_t count);
+
+	void apply();
+
+	// Row-local orientations only need band_rows rows in memory at a time.
+	static void stream(char const* input_filename, char const* output_filename, orientation const& operations, size_t band_rows);
+
+private:
+	pnm_file file;
+	std::unique_ptr<uint8_t[]> buffer;
+	uint8_t* data = nullptr;
+	uint32_t type;
+	uint32_t w, h;
+	uint16_t depth;
+	orientation pending;
+	bool in_place = false;
+	size_t threads = 0;
+
+	void set_buffer(std::unique_ptr<uint8_t[]> new_data);
+};
+
+}
+
+#endif
\ No newline at end of file
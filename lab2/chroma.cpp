@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "chroma.h"
+
+namespace lab2 {
+
+sampling parse_sampling(const std::string &name) {
+	if (name == "4:4:4") return sampling::s444;
+	if (name == "4:2:2") return sampling::s422;
+	if (name == "4:2:0") return sampling::s420;
+	throw std::runtime_error("Unsupported chroma sampling, expected 4:4:4, 4:2:2 or 4:2:0");
+}
+
+bool has_chroma(model color_model) {
+	return color_model == model::YCbCr_601 || color_model == model::YCbCr_709;
+}
+
+size_t chroma_width(sampling chroma, size_t w) {
+	return chroma == sampling::s444 ? w : (w + 1) / 2;
+}
+
+size_t chroma_height(sampling chroma, size_t h) {
+	return chroma == sampling::s420 ? (h + 1) / 2 : h;
+}
+
+size_t chroma_band_rows(sampling chroma, size_t band_rows) {
+	return chroma == sampling::s420 ? band_rows + (band_rows & 1) : band_rows;
+}
+
+void downsample(sampling chroma, const uint8_t* plane, size_t w, size_t rows, uint8_t* samples) {
+	size_t cw = chroma_width(chroma, w);
+	size_t ch = chroma_height(chroma, rows);
+	size_t step = (chroma == sampling::s420 ? 2 : 1);
+	for (size_t y = 0; y < ch; y++) {
+		// A missing column or row repeats the last one.
+		const uint8_t* top = plane + y * step * w;
+		const uint8_t* bottom = plane + std::min(y * step + step - 1, rows - 1) * w;
+		uint8_t* out = samples + y * cw;
+		for (size_t x = 0; x < cw; x++) {
+			size_t left = 2 * x;
+			size_t right = std::min(left + 1, w - 1);
+			out[x] = static_cast<uint8_t>((top[left] + top[right] + bottom[left] + bottom[right] + 2) >> 2);
+		}
+	}
+}
+
+// The nearer sample gets weight 3, the one on the other side of the pixel 1.
+static size_t neighbour(size_t pos, size_t count) {
+	size_t near = pos / 2;
+	if (pos & 1) return std::min(near + 1, count - 1);
+	return near == 0 ? 0 : near - 1;
+}
+
+void upsample(sampling chroma, const uint8_t* samples, size_t w, size_t h, uint8_t* plane) {
+	size_t cw = chroma_width(chroma, w);
+	size_t ch = chroma_height(chroma, h);
+	bool vertical = (chroma == sampling::s420);
+	for (size_t y = 0; y < h; y++) {
+		const uint8_t* near_row = samples + (vertical ? y / 2 : y) * cw;
+		const uint8_t* far_row = samples + (vertical ? neighbour(y, ch) : y) * cw;
+		uint8_t* out = plane + y * w;
+		for (size_t x = 0; x < w; x++) {
+			size_t near = x / 2;
+			size_t far = neighbour(x, cw);
+			unsigned top = 3 * near_row[near] + near_row[far];
+			unsigned bottom = 3 * far_row[near] + far_row[far];
+			out[x] = static_cast<uint8_t>((3 * top + bottom + 8) >> 4);
+		}
+	}
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef LAB2_CHROMA_H
+#define LAB2_CHROMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "color_convert.h"
+
+namespace lab2 {
+
+// Resolution of the second and third planes of a YCbCr image: full, half
+// as wide (4:2:2), or half as wide and half as high (4:2:0). Odd sizes
+// round up, the last sample then covers a single column or row.
+enum class sampling { s444, s422, s420 };
+
+sampling parse_sampling(const std::string &name);
+
+// Only the YCbCr models have channels that can be subsampled.
+bool has_chroma(model color_model);
+
+size_t chroma_width(sampling chroma, size_t w);
+
+size_t chroma_height(sampling chroma, size_t h);
+
+// Bands of a plane that is averaged down have to start on an even row.
+size_t chroma_band_rows(sampling chroma, size_t band_rows);
+
+// Averages rows rows of a plane w wide down to chroma_width x chroma_height
+// samples, each the mean of the 2 or 4 pixels it covers.
+void downsample(sampling chroma, const uint8_t* plane, size_t w, size_t rows, uint8_t* samples);
+
+// Brings a subsampled plane back to w x h. The samples sit in the middle
+// of the pixels they cover and are interpolated with weights 3/4 and 1/4
+// on each subsampled axis.
+void upsample(sampling chroma, const uint8_t* samples, size_t w, size_t h, uint8_t* plane);
+
+}
+
+#endif
\ No newline at end of file
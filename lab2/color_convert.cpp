@@ -0,0 +1,725 @@
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <memory>
+#include <exception>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "color_convert.h"
+
+namespace lab2 {
+
+static const char* const model_names[num_models] = {"RGB", "HSL", "HSV", "YCbCr.601", "YCbCr.709", "YCoCg", "CMY"};
+
+model parse_model(const std::string &name) {
+	for (size_t i = 0; i < num_models; i++) {
+		if (name == model_names[i]) return static_cast<model>(i);
+	}
+	throw std::runtime_error("Unsupported color model");
+}
+
+const char* model_name(model color_model) {
+	return model_names[static_cast<size_t>(color_model)];
+}
+
+static double mod(double a, double num) {
+	while (a < 0) a += num;
+	while (a >= num) a -= num;
+	return a;
+}
+
+// Conversion of one pixel to and from RGB. to_RGB takes values of the model,
+// not necessarily whole, and gives RGB clamped to [0, 255] but not rounded,
+// from_RGB gives the unclamped values of the model; only store() rounds, so
+// every conversion rounds exactly once.
+template<model M>
+struct model_traits;
+
+template<>
+struct model_traits<model::RGB> {
+	static void to_RGB(double const* u, double* rgb) {
+		rgb[0] = u[0];
+		rgb[1] = u[1];
+		rgb[2] = u[2];
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		v[0] = rgb[0];
+		v[1] = rgb[1];
+		v[2] = rgb[2];
+	}
+};
+
+static void clamp_RGB(double* rgb) {
+	for (size_t i = 0; i < 3; i++) {
+		if (rgb[i] < 0) rgb[i] = 0;
+		if (rgb[i] > 255) rgb[i] = 255;
+	}
+}
+
+// Where the kernels find the pixels: value k of pixel i is at
+// c[k][i * stride], stride is 3 for interleaved pixels and 1 for planes.
+struct channels {
+	uint8_t* c[3];
+	size_t stride;
+};
+
+static void store(double const* v, channels const& p, size_t at) {
+	for (size_t k = 0; k < 3; k++) {
+		double x = v[k];
+		if (x < 0) x = 0;
+		if (x > 255) x = 255;
+		p.c[k][at] = static_cast<uint8_t>(round(x));
+	}
+}
+
+// Shared by HSL and HSV once the chroma C, the second largest component X and
+// the offset m are known.
+static void hue_to_RGB(double H, double C, double X, double m, double* rgb) {
+	double r;
+	double g;
+	double b;
+	if (H < 60) {
+		r = C;
+		g = X;
+		b = 0;
+	} else if (H < 120) {
+		r = X;
+		g = C;
+		b = 0;
+	} else if (H < 180) {
+		r = 0;
+		g = C;
+		b = X;
+	} else if (H < 240) {
+		r = 0;
+		g = X;
+		b = C;
+	} else if (H < 300) {
+		r = X;
+		g = 0;
+		b = C;
+	} else {
+		r = C;
+		g = 0;
+		b = X;
+	}
+	rgb[0] = (r + m) * 255;
+	rgb[1] = (g + m) * 255;
+	rgb[2] = (b + m) * 255;
+	clamp_RGB(rgb);
+}
+
+static double RGB_to_hue(double r, double g, double b, double cmax, double delta) {
+	double H;
+	if (delta == 0) {
+		H = 0;
+	} else if (r == cmax) {
+		H = 60 * mod((g - b) / delta, 6);
+	} else if (g == cmax) {
+		H = 60 * ((b - r) / delta + 2);
+	} else {
+		H = 60 * ((r - g) / delta + 4);
+	}
+	H = mod(H, 360);
+	return H / 360 * 255;
+}
+
+template<>
+struct model_traits<model::HSL> {
+	static void to_RGB(double const* u, double* rgb) {
+		double H = u[0] / 255 * 360;
+		if (H == 360) H = 0;
+		double S = u[1] / 255;
+		double L = u[2] / 255;
+		double C = (1 - std::abs(2 * L - 1)) * S;
+		double X = C * (1.0 - std::abs(mod(H / 60, 2) - 1.0));
+		double m = L - C / 2.0;
+		hue_to_RGB(H, C, X, m, rgb);
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		double r = rgb[0] / 255;
+		double g = rgb[1] / 255;
+		double b = rgb[2] / 255;
+		double cmax = std::max(std::max(r, g), b);
+		double cmin = std::min(std::min(r, g), b);
+		double delta = cmax - cmin;
+		double L = (cmax + cmin) / 2;
+		double S;
+		if (delta == 0) {
+			S = 0;
+		} else {
+			S = delta / (1 - std::abs(2 * L - 1));
+		}
+		v[0] = RGB_to_hue(r, g, b, cmax, delta);
+		v[1] = S * 255;
+		v[2] = L * 255;
+	}
+};
+
+template<>
+struct model_traits<model::HSV> {
+	static void to_RGB(double const* u, double* rgb) {
+		double H = u[0] / 255 * 360;
+		if (H == 360) H = 0;
+		double S = u[1] / 255;
+		double V = u[2] / 255;
+		double C = V * S;
+		double X = C * (1 - std::abs(mod(H / 60, 2) - 1));
+		double m = V - C;
+		hue_to_RGB(H, C, X, m, rgb);
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		double r = rgb[0] / 255;
+		double g = rgb[1] / 255;
+		double b = rgb[2] / 255;
+		double cmax = std::max(std::max(r, g), b);
+		double cmin = std::min(std::min(r, g), b);
+		double delta = cmax - cmin;
+		double S;
+		if (cmax == 0) {
+			S = 0;
+		} else {
+			S = delta / cmax;
+		}
+		v[0] = RGB_to_hue(r, g, b, cmax, delta);
+		v[1] = S * 255;
+		v[2] = cmax * 255;
+	}
+};
+
+template<>
+struct model_traits<model::YCbCr_601> {
+	static void to_RGB(double const* u, double* rgb) {
+		double Y = u[0];
+		double Cb = u[1];
+		double Cr = u[2];
+		rgb[0] = Y + (Cr - 128) * 1.402;
+		rgb[1] = Y - (Cb - 128) * 0.344136 - (Cr - 128) * 0.714136;
+		rgb[2] = Y + (Cb - 128) * 1.772;
+		clamp_RGB(rgb);
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		double r = rgb[0];
+		double g = rgb[1];
+		double b = rgb[2];
+		v[0] = 0.299 * r + 0.587 * g + 0.114 * b;
+		v[1] = 128 - 0.168736 * r - 0.331264 * g + 0.5 * b;
+		v[2] = 128 + 0.5 * r - 0.418688 * g - 0.081312 * b;
+	}
+};
+
+template<>
+struct model_traits<model::YCbCr_709> {
+	static void to_RGB(double const* u, double* rgb) {
+		double Y = u[0];
+		double Cb = u[1];
+		double Cr = u[2];
+		double y = (Y / 255 * 219) + 16;
+		double cb = (Cb / 255 * 224) + 16;
+		double cr = (Cr / 255 * 224) + 16;
+		double r = y + (cr - 128) * 1.539648;
+		double g = y - (cb - 128) * 0.1831429 - (cr - 128) * 0.457675;
+		double b = y + (cb - 128) * 1.81418;
+		if (r < 16) r = 16;
+		if (r > 235) r = 235;
+		if (g < 16) g = 16;
+		if (g > 235) g = 235;
+		if (b < 16) b = 16;
+		if (b > 235) b = 235;
+		rgb[0] = (r - 16) / 219 * 255;
+		rgb[1] = (g - 16) / 219 * 255;
+		rgb[2] = (b - 16) / 219 * 255;
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		double r = rgb[0];
+		double g = rgb[1];
+		double b = rgb[2];
+		double Y = (46.742 * r + 157.243 * g + 15.874 * b) / 256 + 16;
+		double Cb = (-25.765 * r - 86.674 * g + 112.439 * b) / 256 + 128;
+		double Cr = (112.439 * r - 102.129 * g - 10.310 * b) / 256 + 128;
+		v[0] = (Y - 16) / 219 * 255;
+		v[1] = (Cb - 16) / 224 * 255;
+		v[2] = (Cr - 16) / 224 * 255;
+	}
+};
+
+template<>
+struct model_traits<model::YCoCg> {
+	static void to_RGB(double const* u, double* rgb) {
+		double Y = u[0];
+		double Co = u[1];
+		double Cg = u[2];
+		double y = Y / 255;
+		double co = Co / 255 - 0.5;
+		double cg = Cg / 255 - 0.5;
+		rgb[0] = (y + co - cg) * 255;
+		rgb[1] = (y + cg) * 255;
+		rgb[2] = (y - co - cg) * 255;
+		clamp_RGB(rgb);
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		double r = rgb[0] / 255;
+		double g = rgb[1] / 255;
+		double b = rgb[2] / 255;
+		double y = 0.25 * r + 0.5 * g + 0.25 * b;
+		double co = 0.5 * r - 0.5 * b;
+		double cg = -0.25 * r + 0.5 * g - 0.25 * b;
+		v[0] = y * 255;
+		v[1] = (co + 0.5) * 255;
+		v[2] = (cg + 0.5) * 255;
+	}
+};
+
+template<>
+struct model_traits<model::CMY> {
+	static void to_RGB(double const* u, double* rgb) {
+		rgb[0] = 255 - u[0];
+		rgb[1] = 255 - u[1];
+		rgb[2] = 255 - u[2];
+	}
+
+	static void from_RGB(double const* rgb, double* v) {
+		v[0] = 255 - rgb[0];
+		v[1] = 255 - rgb[1];
+		v[2] = 255 - rgb[2];
+	}
+};
+
+// Models other than RGB that are an affine map of RGB. CMY is left out: it is
+// exact both ways, so it gains nothing from a fused matrix.
+static constexpr bool is_linear(model m) {
+	return m == model::YCbCr_601 || m == model::YCbCr_709 || m == model::YCoCg;
+}
+
+// v = m * u + c
+struct affine {
+	double m[3][3];
+	double c[3];
+};
+
+// Recovers the affine map behind a conversion of a linear model from its
+// values around mid grey, where none of the conversions clamp.
+template<typename F>
+static affine sample_affine(F const& f) {
+	double const centre = 128;
+	double u[3] = {centre, centre, centre};
+	double base[3];
+	f(u, base);
+	affine a;
+	for (size_t j = 0; j < 3; j++) {
+		double column[3];
+		u[j] = centre + 1;
+		f(u, column);
+		u[j] = centre;
+		for (size_t i = 0; i < 3; i++) a.m[i][j] = column[i] - base[i];
+	}
+	for (size_t i = 0; i < 3; i++) {
+		a.c[i] = base[i] - (a.m[i][0] + a.m[i][1] + a.m[i][2]) * centre;
+	}
+	return a;
+}
+
+// The map that applies first, then second.
+static affine compose(affine const& first, affine const& second) {
+	affine a;
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 3; j++) {
+			a.m[i][j] = 0;
+			for (size_t k = 0; k < 3; k++) a.m[i][j] += second.m[i][k] * first.m[k][j];
+		}
+		a.c[i] = second.c[i];
+		for (size_t k = 0; k < 3; k++) a.c[i] += second.m[i][k] * first.c[k];
+	}
+	return a;
+}
+
+template<model From, model To>
+static affine direct_map() {
+	affine to_RGB = sample_affine(model_traits<From>::to_RGB);
+	affine from_RGB = sample_affine(model_traits<To>::from_RGB);
+	return compose(to_RGB, from_RGB);
+}
+
+// Pairs of linear models are one 3x3 matrix and an offset. Out of gamut
+// inputs are no longer clamped to RGB on the way, only the result is.
+// Everything else goes through RGB in doubles, without rounding in between.
+template<model From, model To>
+static void convert_kernel(channels const& p, size_t length) {
+	if constexpr (is_linear(From) && is_linear(To)) {
+		static affine const map = direct_map<From, To>();
+		for (size_t i = 0, at = 0; i < length; i++, at += p.stride) {
+			double u0 = p.c[0][at];
+			double u1 = p.c[1][at];
+			double u2 = p.c[2][at];
+			double v[3];
+			for (size_t j = 0; j < 3; j++) {
+				v[j] = map.m[j][0] * u0 + map.m[j][1] * u1 + map.m[j][2] * u2 + map.c[j];
+			}
+			store(v, p, at);
+		}
+	} else {
+		for (size_t i = 0, at = 0; i < length; i++, at += p.stride) {
+			double u[3] = {static_cast<double>(p.c[0][at]), static_cast<double>(p.c[1][at]), static_cast<double>(p.c[2][at])};
+			double rgb[3];
+			double v[3];
+			model_traits<From>::to_RGB(u, rgb);
+			model_traits<To>::from_RGB(rgb, v);
+			store(v, p, at);
+		}
+	}
+}
+
+static constexpr bool is_affine(model m) {
+	return m == model::RGB || is_linear(m);
+}
+
+// An affine map in fixed point: v = (m * u + offset) >> shift, where offset
+// also holds the rounding half. The shift is as large as the int16
+// coefficients allow, which keeps the error against the doubles within 1.
+struct fixed_affine {
+	int16_t m[3][3];
+	int32_t offset[3];
+	int shift;
+};
+
+static fixed_affine to_fixed(affine const& a) {
+	double largest = 0;
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 3; j++) largest = std::max(largest, std::abs(a.m[i][j]));
+	}
+	int shift = 14;
+	while (shift > 1 && std::round(largest * (1 << shift)) > 32767) shift--;
+	fixed_affine f;
+	f.shift = shift;
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 3; j++) f.m[i][j] = static_cast<int16_t>(std::lround(a.m[i][j] * (1 << shift)));
+		f.offset[i] = static_cast<int32_t>(std::lround(a.c[i] * (1 << shift))) + (1 << (shift - 1));
+	}
+	return f;
+}
+
+static void fixed_pixel(fixed_affine const& f, channels const& p, size_t at) {
+	int32_t u0 = p.c[0][at];
+	int32_t u1 = p.c[1][at];
+	int32_t u2 = p.c[2][at];
+	for (size_t k = 0; k < 3; k++) {
+		int32_t v = (f.m[k][0] * u0 + f.m[k][1] * u1 + f.m[k][2] * u2 + f.offset[k]) >> f.shift;
+		p.c[k][at] = static_cast<uint8_t>(std::min(std::max(v, 0), 255));
+	}
+}
+
+#ifdef __SSE2__
+// Splits 16 interleaved pixels into one register per channel and back.
+static void load_planes(uint8_t const* ptr, __m128i& r, __m128i& g, __m128i& b) {
+#ifdef __SSSE3__
+	__m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ptr));
+	__m128i y = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ptr + 16));
+	__m128i z = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ptr + 32));
+	r = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(x, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+	g = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(x, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+	b = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(x, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+		_mm_shuffle_epi8(y, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+		_mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+#else
+	alignas(16) uint8_t planes[3][16];
+	for (size_t i = 0; i < 16; i++) {
+		planes[0][i] = ptr[3 * i];
+		planes[1][i] = ptr[3 * i + 1];
+		planes[2][i] = ptr[3 * i + 2];
+	}
+	r = _mm_load_si128(reinterpret_cast<__m128i const*>(planes[0]));
+	g = _mm_load_si128(reinterpret_cast<__m128i const*>(planes[1]));
+	b = _mm_load_si128(reinterpret_cast<__m128i const*>(planes[2]));
+#endif
+}
+
+static void store_planes(uint8_t* ptr, __m128i r, __m128i g, __m128i b) {
+#ifdef __SSSE3__
+	__m128i x = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+		_mm_shuffle_epi8(g, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),
+		_mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+	__m128i y = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),
+		_mm_shuffle_epi8(g, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),
+		_mm_shuffle_epi8(b, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));
+	__m128i z = _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(r, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),
+		_mm_shuffle_epi8(g, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),
+		_mm_shuffle_epi8(b, _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), x);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr + 16), y);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr + 32), z);
+#else
+	alignas(16) uint8_t planes[3][16];
+	_mm_store_si128(reinterpret_cast<__m128i*>(planes[0]), r);
+	_mm_store_si128(reinterpret_cast<__m128i*>(planes[1]), g);
+	_mm_store_si128(reinterpret_cast<__m128i*>(planes[2]), b);
+	for (size_t i = 0; i < 16; i++) {
+		ptr[3 * i] = planes[0][i];
+		ptr[3 * i + 1] = planes[1][i];
+		ptr[3 * i + 2] = planes[2][i];
+	}
+#endif
+}
+
+// Coefficients laid out for pmaddwd: (m0, m1) against interleaved (r, g)
+// words and (m2, 0) against (b, 0).
+static int32_t coefficient_pair(int16_t low, int16_t high) {
+	return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(high)) << 16 | static_cast<uint16_t>(low));
+}
+
+#ifdef __AVX2__
+struct fixed_vectors {
+	__m256i rg[3];
+	__m256i b[3];
+	__m256i offset[3];
+	__m128i shift;
+
+	explicit fixed_vectors(fixed_affine const& f) {
+		for (size_t i = 0; i < 3; i++) {
+			rg[i] = _mm256_set1_epi32(coefficient_pair(f.m[i][0], f.m[i][1]));
+			b[i] = _mm256_set1_epi32(coefficient_pair(f.m[i][2], 0));
+			offset[i] = _mm256_set1_epi32(f.offset[i]);
+		}
+		shift = _mm_cvtsi32_si128(f.shift);
+	}
+};
+
+static void transform_planes(fixed_vectors const& v, __m128i& r, __m128i& g, __m128i& b) {
+	__m256i zero = _mm256_setzero_si256();
+	__m256i r16 = _mm256_cvtepu8_epi16(r);
+	__m256i g16 = _mm256_cvtepu8_epi16(g);
+	__m256i b16 = _mm256_cvtepu8_epi16(b);
+	__m256i rg_lo = _mm256_unpacklo_epi16(r16, g16);
+	__m256i rg_hi = _mm256_unpackhi_epi16(r16, g16);
+	__m256i b_lo = _mm256_unpacklo_epi16(b16, zero);
+	__m256i b_hi = _mm256_unpackhi_epi16(b16, zero);
+	__m128i out[3];
+	for (size_t i = 0; i < 3; i++) {
+		__m256i lo = _mm256_add_epi32(_mm256_madd_epi16(rg_lo, v.rg[i]), _mm256_madd_epi16(b_lo, v.b[i]));
+		__m256i hi = _mm256_add_epi32(_mm256_madd_epi16(rg_hi, v.rg[i]), _mm256_madd_epi16(b_hi, v.b[i]));
+		lo = _mm256_sra_epi32(_mm256_add_epi32(lo, v.offset[i]), v.shift);
+		hi = _mm256_sra_epi32(_mm256_add_epi32(hi, v.offset[i]), v.shift);
+		__m256i words = _mm256_packs_epi32(lo, hi);
+		out[i] = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+	}
+	r = out[0];
+	g = out[1];
+	b = out[2];
+}
+#else
+struct fixed_vectors {
+	__m128i rg[3];
+	__m128i b[3];
+	__m128i offset[3];
+	__m128i shift;
+
+	explicit fixed_vectors(fixed_affine const& f) {
+		for (size_t i = 0; i < 3; i++) {
+			rg[i] = _mm_set1_epi32(coefficient_pair(f.m[i][0], f.m[i][1]));
+			b[i] = _mm_set1_epi32(coefficient_pair(f.m[i][2], 0));
+			offset[i] = _mm_set1_epi32(f.offset[i]);
+		}
+		shift = _mm_cvtsi32_si128(f.shift);
+	}
+};
+
+// Eight pixels of one output channel as int16.
+static __m128i transform_half(fixed_vectors const& v, size_t i, __m128i r16, __m128i g16, __m128i b16) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r16, g16), v.rg[i]), _mm_madd_epi16(_mm_unpacklo_epi16(b16, zero), v.b[i]));
+	__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r16, g16), v.rg[i]), _mm_madd_epi16(_mm_unpackhi_epi16(b16, zero), v.b[i]));
+	lo = _mm_sra_epi32(_mm_add_epi32(lo, v.offset[i]), v.shift);
+	hi = _mm_sra_epi32(_mm_add_epi32(hi, v.offset[i]), v.shift);
+	return _mm_packs_epi32(lo, hi);
+}
+
+static void transform_planes(fixed_vectors const& v, __m128i& r, __m128i& g, __m128i& b) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i r_lo = _mm_unpacklo_epi8(r, zero);
+	__m128i r_hi = _mm_unpackhi_epi8(r, zero);
+	__m128i g_lo = _mm_unpacklo_epi8(g, zero);
+	__m128i g_hi = _mm_unpackhi_epi8(g, zero);
+	__m128i b_lo = _mm_unpacklo_epi8(b, zero);
+	__m128i b_hi = _mm_unpackhi_epi8(b, zero);
+	__m128i out[3];
+	for (size_t i = 0; i < 3; i++) {
+		out[i] = _mm_packus_epi16(transform_half(v, i, r_lo, g_lo, b_lo), transform_half(v, i, r_hi, g_hi, b_hi));
+	}
+	r = out[0];
+	g = out[1];
+	b = out[2];
+}
+#endif
+#endif
+
+static void convert_fixed(fixed_affine const& f, channels const& p, size_t length) {
+	size_t i = 0;
+#ifdef __SSE2__
+	fixed_vectors const vectors(f);
+	__m128i r;
+	__m128i g;
+	__m128i b;
+	if (p.stride == 3) {
+		for (; i + 16 <= length; i += 16) {
+			load_planes(p.c[0] + 3 * i, r, g, b);
+			transform_planes(vectors, r, g, b);
+			store_planes(p.c[0] + 3 * i, r, g, b);
+		}
+	} else {
+		for (; i + 16 <= length; i += 16) {
+			r = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p.c[0] + i));
+			g = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p.c[1] + i));
+			b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p.c[2] + i));
+			transform_planes(vectors, r, g, b);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p.c[0] + i), r);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p.c[1] + i), g);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p.c[2] + i), b);
+		}
+	}
+#endif
+	for (; i < length; i++) fixed_pixel(f, p, i * p.stride);
+}
+
+template<model From, model To>
+static void fixed_kernel(channels const& p, size_t length) {
+	static fixed_affine const map = to_fixed(direct_map<From, To>());
+	convert_fixed(map, p, length);
+}
+
+// Pairs of RGB, YCbCr.601, YCbCr.709 and YCoCg run in fixed point, the
+// double kernels stay as the reference they are checked against.
+template<bool Reference, model From, model To>
+static void pair_kernel(channels const& p, size_t length) {
+	if constexpr (!Reference && From != To && is_affine(From) && is_affine(To)) {
+		fixed_kernel<From, To>(p, length);
+	} else {
+		convert_kernel<From, To>(p, length);
+	}
+}
+
+using kernel = void (*)(channels const&, size_t);
+
+template<bool Reference, model From, size_t... To>
+static constexpr std::array<kernel, num_models> kernel_row(std::index_sequence<To...>) {
+	return {pair_kernel<Reference, From, static_cast<model>(To)>...};
+}
+
+template<bool Reference, size_t... From>
+static constexpr std::array<std::array<kernel, num_models>, num_models> kernel_table(std::index_sequence<From...>) {
+	return {kernel_row<Reference, static_cast<model>(From)>(std::make_index_sequence<num_models>())...};
+}
+
+static constexpr std::array<std::array<kernel, num_models>, num_models> kernels = kernel_table<false>(std::make_index_sequence<num_models>());
+
+static constexpr std::array<std::array<kernel, num_models>, num_models> reference_kernels = kernel_table<true>(std::make_index_sequence<num_models>());
+
+void convert_pixels(model from, model to, uint8_t* ptr, size_t length) {
+	if (from == to) return;
+	kernels[static_cast<size_t>(from)][static_cast<size_t>(to)]({{ptr, ptr + 1, ptr + 2}, 3}, length);
+}
+
+void convert_planes(model from, model to, uint8_t* const planes[3], size_t length) {
+	if (from == to) return;
+	kernels[static_cast<size_t>(from)][static_cast<size_t>(to)]({{planes[0], planes[1], planes[2]}, 1}, length);
+}
+
+// Follows the pixel kernels: pairs of affine models go through their direct
+// map without clamping to RGB, the others through RGB.
+template<model From, model To>
+static void pair_value(double const* u, double* v) {
+	if constexpr (From == To) {
+		for (size_t k = 0; k < 3; k++) v[k] = u[k];
+	} else if constexpr (is_affine(From) && is_affine(To)) {
+		static affine const map = direct_map<From, To>();
+		for (size_t j = 0; j < 3; j++) {
+			v[j] = map.m[j][0] * u[0] + map.m[j][1] * u[1] + map.m[j][2] * u[2] + map.c[j];
+		}
+	} else {
+		double rgb[3];
+		model_traits<From>::to_RGB(u, rgb);
+		model_traits<To>::from_RGB(rgb, v);
+	}
+}
+
+using value_kernel = void (*)(double const*, double*);
+
+template<model From, size_t... To>
+static constexpr std::array<value_kernel, num_models> value_row(std::index_sequence<To...>) {
+	return {pair_value<From, static_cast<model>(To)>...};
+}
+
+template<size_t... From>
+static constexpr std::array<std::array<value_kernel, num_models>, num_models> value_table(std::index_sequence<From...>) {
+	return {value_row<static_cast<model>(From)>(std::make_index_sequence<num_models>())...};
+}
+
+static constexpr std::array<std::array<value_kernel, num_models>, num_models> value_kernels = value_table(std::make_index_sequence<num_models>());
+
+void convert_value(model from, model to, double const* u, double* v) {
+	value_kernels[static_cast<size_t>(from)][static_cast<size_t>(to)](u, v);
+}
+
+bool is_fixed_point(model from, model to) {
+	return from != to && is_affine(from) && is_affine(to);
+}
+
+conversion_error verify_fixed_point(model from, model to) {
+	size_t const chunk = 1 << 16;
+	size_t const total = 1 << 24;
+	std::unique_ptr<uint8_t[]> expected;
+	std::unique_ptr<uint8_t[]> actual;
+	try {
+		expected = std::unique_ptr<uint8_t[]>(new uint8_t[chunk * 3]);
+		actual = std::unique_ptr<uint8_t[]>(new uint8_t[chunk * 3]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	kernel reference = reference_kernels[static_cast<size_t>(from)][static_cast<size_t>(to)];
+	kernel fast = kernels[static_cast<size_t>(from)][static_cast<size_t>(to)];
+	conversion_error error = {0, 0, total * 3};
+	for (size_t first = 0; first < total; first += chunk) {
+		for (size_t i = 0; i < chunk; i++) {
+			size_t value = first + i;
+			expected[3 * i] = static_cast<uint8_t>(value >> 16);
+			expected[3 * i + 1] = static_cast<uint8_t>(value >> 8);
+			expected[3 * i + 2] = static_cast<uint8_t>(value);
+		}
+		std::copy(expected.get(), expected.get() + chunk * 3, actual.get());
+		reference({{expected.get(), expected.get() + 1, expected.get() + 2}, 3}, chunk);
+		fast({{actual.get(), actual.get() + 1, actual.get() + 2}, 3}, chunk);
+		for (size_t i = 0; i < chunk * 3; i++) {
+			unsigned difference = static_cast<unsigned>(std::abs(expected[i] - actual[i]));
+			if (difference != 0) error.mismatches++;
+			error.max = std::max(error.max, difference);
+		}
+	}
+	return error;
+}
+
+}
\ No newline at end of file
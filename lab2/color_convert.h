@@ -0,0 +1,47 @@
+#ifndef LAB2_COLOR_CONVERT_H
+#define LAB2_COLOR_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lab2 {
+
+enum class model { RGB, HSL, HSV, YCbCr_601, YCbCr_709, YCoCg, CMY };
+
+size_t const num_models = 7;
+
+// Parses the name used on the command line, e.g. "YCbCr.601".
+model parse_model(const std::string &name);
+
+const char* model_name(model color_model);
+
+// Converts length interleaved pixels in place. Every (from, to) pair has its
+// own kernel with both conversions inlined, the model is never looked at per
+// pixel, and each pixel is rounded once, not once per step through RGB.
+void convert_pixels(model from, model to, uint8_t* ptr, size_t length);
+
+// The same for an image kept as three planes of length values each.
+void convert_planes(model from, model to, uint8_t* const planes[3], size_t length);
+
+// Converts one pixel in double precision the way convert_pixels does, without
+// rounding or clamping the result. u does not have to hold whole numbers.
+void convert_value(model from, model to, double const* u, double* v);
+
+// Pairs of RGB, YCbCr.601, YCbCr.709 and YCoCg are converted in fixed point.
+bool is_fixed_point(model from, model to);
+
+struct conversion_error {
+	unsigned max;
+	// Channel values that differ from the reference, out of values.
+	uint64_t mismatches;
+	uint64_t values;
+};
+
+// Converts all 2^24 inputs with the fixed point kernel of the pair and with
+// the double precision one, and compares the results.
+conversion_error verify_fixed_point(model from, model to);
+
+}
+
+#endif
\ No newline at end of file
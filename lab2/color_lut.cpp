@@ -0,0 +1,254 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../common/atomic_file.h"
+#include "../common/parallel.h"
+#include "color_lut.h"
+
+namespace lab2 {
+
+// File layout: the table header with the source and target models and the
+// layout as parameters, then the table.
+static char const magic[8] = {'L', 'A', 'B', '2', 'L', 'U', 'T', '1'};
+
+// Grid points along each axis, the input value of point k is k * 255 / grid_step.
+// Every point takes four floats, the last one unused, so that it is one aligned
+// vector.
+static size_t const grid_step = 32;
+static size_t const grid_points = grid_step + 1;
+static size_t const grid_channels = 4;
+
+static size_t table_size(color_lut::layout kind) {
+	if (kind == color_lut::layout::full) return size_t(3) << 24;
+	return grid_points * grid_points * grid_points * grid_channels * sizeof(float);
+}
+
+static bool has_hue(model color_model) {
+	return color_model == model::HSL || color_model == model::HSV;
+}
+
+color_lut::layout parse_layout(const std::string &name) {
+	if (name == "full") return color_lut::layout::full;
+	if (name == "grid") return color_lut::layout::grid;
+	throw std::runtime_error("Unsupported lookup table, expected full or grid");
+}
+
+color_lut::color_lut(model from, model to, layout kind, size_t threads) : source(from), target(to), table_layout(kind) {
+	try {
+		buffer = std::unique_ptr<uint8_t[]>(new uint8_t[table_size(kind)]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	table = buffer.get();
+	if (kind == layout::full) {
+		uint8_t* values = buffer.get();
+		parallel_bands(size_t(1) << 24, 3 * 64, threads, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				values[3 * i] = static_cast<uint8_t>(i >> 16);
+				values[3 * i + 1] = static_cast<uint8_t>(i >> 8);
+				values[3 * i + 2] = static_cast<uint8_t>(i);
+			}
+			convert_pixels(from, to, values + 3 * begin, end - begin);
+		});
+	} else {
+		float* samples = reinterpret_cast<float*>(buffer.get());
+		for (size_t i = 0; i < grid_points; i++) {
+			for (size_t j = 0; j < grid_points; j++) {
+				for (size_t k = 0; k < grid_points; k++) {
+					double u[3] = {255.0 * i / grid_step, 255.0 * j / grid_step, 255.0 * k / grid_step};
+					double v[3];
+					convert_value(from, to, u, v);
+					for (size_t c = 0; c < 3; c++) *(samples++) = static_cast<float>(v[c]);
+					*(samples++) = 0;
+				}
+			}
+		}
+	}
+}
+
+color_lut::color_lut(const std::string &filename) : file(filename) {
+	uint8_t const* params = table_params(file, magic);
+	if (params == nullptr || params[0] >= num_models || params[1] >= num_models || params[2] > 1) {
+		throw std::runtime_error("Incorrect format of lookup table");
+	}
+	source = static_cast<model>(params[0]);
+	target = static_cast<model>(params[1]);
+	table_layout = static_cast<layout>(params[2]);
+	if (file.size() != table_header_size + table_size(table_layout)) throw std::runtime_error("Incorrect format of lookup table");
+	table = file.data() + table_header_size;
+}
+
+void color_lut::save(const std::string &filename) const {
+	uint8_t const params[3] = {static_cast<uint8_t>(source), static_cast<uint8_t>(target), static_cast<uint8_t>(table_layout)};
+	save_table(filename, magic, params, sizeof(params), table, table_size(table_layout));
+}
+
+// The cell of the grid an input value falls into and how far along it is.
+struct grid_axis {
+	uint32_t cell[256];
+	float t[256];
+
+	grid_axis() {
+		for (size_t u = 0; u < 256; u++) {
+			size_t position = u * grid_step;
+			cell[u] = static_cast<uint32_t>(std::min(position / 255, grid_step - 1));
+			t[u] = static_cast<float>(position - cell[u] * 255) / 255;
+		}
+	}
+};
+
+#ifdef __SSE2__
+static __m128 lerp(__m128 a, __m128 b, __m128 t) {
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+template<bool Hue>
+static void apply_grid(float const* samples, uint8_t* const c[3], size_t stride, size_t length) {
+	static grid_axis const axis;
+	size_t const stride0 = grid_points * grid_points * grid_channels;
+	size_t const stride1 = grid_points * grid_channels;
+	size_t const stride2 = grid_channels;
+	// Hue is an angle and only sits in the first lane: every corner is moved
+	// by a turn if that brings it nearer to the first corner.
+	__m128 const turn = _mm_setr_ps(255, 0, 0, 0);
+	__m128 const half_turn = _mm_set1_ps(127.5f);
+	__m128 const minus_half_turn = _mm_set1_ps(-127.5f);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const top = _mm_set1_ps(255);
+	__m128 const half = _mm_set1_ps(0.5f);
+	for (size_t i = 0, at = 0; i < length; i++, at += stride) {
+		uint8_t u0 = c[0][at];
+		uint8_t u1 = c[1][at];
+		uint8_t u2 = c[2][at];
+		float const* s = samples + axis.cell[u0] * stride0 + axis.cell[u1] * stride1 + axis.cell[u2] * stride2;
+		__m128 c000 = _mm_load_ps(s);
+		__m128 c001 = _mm_load_ps(s + stride2);
+		__m128 c010 = _mm_load_ps(s + stride1);
+		__m128 c011 = _mm_load_ps(s + stride1 + stride2);
+		__m128 c100 = _mm_load_ps(s + stride0);
+		__m128 c101 = _mm_load_ps(s + stride0 + stride2);
+		__m128 c110 = _mm_load_ps(s + stride0 + stride1);
+		__m128 c111 = _mm_load_ps(s + stride0 + stride1 + stride2);
+		if (Hue) {
+			__m128 first = _mm_shuffle_ps(c000, c000, 0);
+			auto near = [&](__m128 x) {
+				__m128 d = _mm_sub_ps(x, first);
+				x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpgt_ps(d, half_turn), turn));
+				return _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(d, minus_half_turn), turn));
+			};
+			c001 = near(c001);
+			c010 = near(c010);
+			c011 = near(c011);
+			c100 = near(c100);
+			c101 = near(c101);
+			c110 = near(c110);
+			c111 = near(c111);
+		}
+		__m128 t0 = _mm_set1_ps(axis.t[u0]);
+		__m128 t1 = _mm_set1_ps(axis.t[u1]);
+		__m128 t2 = _mm_set1_ps(axis.t[u2]);
+		__m128 v = lerp(lerp(lerp(c000, c001, t2), lerp(c010, c011, t2), t1), lerp(lerp(c100, c101, t2), lerp(c110, c111, t2), t1), t0);
+		if (Hue) {
+			v = _mm_add_ps(v, _mm_and_ps(_mm_cmplt_ps(v, zero), turn));
+			v = _mm_sub_ps(v, _mm_and_ps(_mm_cmpge_ps(v, top), turn));
+		}
+		v = _mm_add_ps(_mm_min_ps(_mm_max_ps(v, zero), top), half);
+		__m128i words = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+		uint32_t bytes = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(words, words)));
+		c[0][at] = static_cast<uint8_t>(bytes);
+		c[1][at] = static_cast<uint8_t>(bytes >> 8);
+		c[2][at] = static_cast<uint8_t>(bytes >> 16);
+	}
+}
+#else
+static uint8_t round_value(float x) {
+	if (x < 0) x = 0;
+	if (x > 255) x = 255;
+	return static_cast<uint8_t>(x + 0.5f);
+}
+
+static float lerp(float a, float b, float t) {
+	return a + (b - a) * t;
+}
+
+// Hue is an angle: every corner is moved by a turn if that brings it nearer
+// to the first corner.
+static float near_hue(float h, float first) {
+	float d = h - first;
+	return h - (d > 127.5f ? 255.0f : 0.0f) + (d < -127.5f ? 255.0f : 0.0f);
+}
+
+template<bool Hue>
+static void apply_grid(float const* samples, uint8_t* const c[3], size_t stride, size_t length) {
+	static grid_axis const axis;
+	size_t const stride0 = grid_points * grid_points * grid_channels;
+	size_t const stride1 = grid_points * grid_channels;
+	size_t const stride2 = grid_channels;
+	for (size_t i = 0, at = 0; i < length; i++, at += stride) {
+		uint8_t u0 = c[0][at];
+		uint8_t u1 = c[1][at];
+		uint8_t u2 = c[2][at];
+		float const* s = samples + axis.cell[u0] * stride0 + axis.cell[u1] * stride1 + axis.cell[u2] * stride2;
+		float const* corners[8] = {s, s + stride2, s + stride1, s + stride1 + stride2,
+			s + stride0, s + stride0 + stride2, s + stride0 + stride1, s + stride0 + stride1 + stride2};
+		float t0 = axis.t[u0];
+		float t1 = axis.t[u1];
+		float t2 = axis.t[u2];
+		float v[3];
+		for (size_t k = 0; k < 3; k++) {
+			float x[8];
+			for (size_t j = 0; j < 8; j++) x[j] = corners[j][k];
+			if (Hue && k == 0) {
+				for (size_t j = 1; j < 8; j++) x[j] = near_hue(x[j], x[0]);
+			}
+			v[k] = lerp(lerp(lerp(x[0], x[1], t2), lerp(x[2], x[3], t2), t1), lerp(lerp(x[4], x[5], t2), lerp(x[6], x[7], t2), t1), t0);
+		}
+		if (Hue) {
+			v[0] += (v[0] < 0 ? 255.0f : 0.0f);
+			v[0] -= (v[0] >= 255 ? 255.0f : 0.0f);
+		}
+		c[0][at] = round_value(v[0]);
+		c[1][at] = round_value(v[1]);
+		c[2][at] = round_value(v[2]);
+	}
+}
+#endif
+
+void color_lut::apply(uint8_t* ptr, size_t length) const {
+	uint8_t* const c[3] = {ptr, ptr + 1, ptr + 2};
+	apply(c, 3, length);
+}
+
+void color_lut::apply_planes(uint8_t* const planes[3], size_t length) const {
+	apply(planes, 1, length);
+}
+
+void color_lut::apply(uint8_t* const c[3], size_t stride, size_t length) const {
+	if (table_layout == layout::full) {
+		for (size_t i = 0, at = 0; i < length; i++, at += stride) {
+			uint8_t const* v = table + 3 * (static_cast<size_t>(c[0][at]) << 16 | static_cast<size_t>(c[1][at]) << 8 | c[2][at]);
+			c[0][at] = v[0];
+			c[1][at] = v[1];
+			c[2][at] = v[2];
+		}
+	} else if (has_hue(target)) {
+		apply_grid<true>(reinterpret_cast<float const*>(table), c, stride, length);
+	} else {
+		apply_grid<false>(reinterpret_cast<float const*>(table), c, stride, length);
+	}
+}
+
+color_lut open_lut(const std::string &filename, model from, model to, color_lut::layout kind, size_t threads) {
+	return open_cached<color_lut>(filename,
+		[&](const color_lut& lut) { return lut.from() == from && lut.to() == to && lut.kind() == kind; },
+		[&]() { return color_lut(from, to, kind, threads); });
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef LAB2_COLOR_LUT_H
+#define LAB2_COLOR_LUT_H
+
+#include <memory>
+#include <cstdint>
+#include <string>
+
+#include "../common/mapped_file.h"
+#include "color_convert.h"
+
+namespace lab2 {
+
+// A conversion tabulated over the whole input cube. A full table holds the
+// result for every one of the 2^24 inputs (48 MiB) and gives exactly what
+// convert_pixels gives. A grid table holds 33^3 unrounded samples and
+// interpolates between them trilinearly, hue going the short way round.
+// The table never changes once built, so any number of threads can apply it.
+struct color_lut {
+	enum class layout { full, grid };
+
+	// Builds the table, the full one over threads threads (0: one per hardware thread).
+	color_lut(model from, model to, layout kind, size_t threads = 0);
+
+	// Maps a table written by save().
+	explicit color_lut(const std::string &filename);
+
+	color_lut(const color_lut&) = delete;
+
+	color_lut& operator=(const color_lut&) = delete;
+
+	color_lut(color_lut&&) = default;
+
+	color_lut& operator=(color_lut&&) = default;
+
+	~color_lut() = default;
+
+	void save(const std::string &filename) const;
+
+	void apply(uint8_t* ptr, size_t length) const;
+
+	void apply_planes(uint8_t* const planes[3], size_t length) const;
+
+	model from() const {
+		return source;
+	}
+
+	model to() const {
+		return target;
+	}
+
+	layout kind() const {
+		return table_layout;
+	}
+
+private:
+	model source;
+	model target;
+	layout table_layout;
+	mapped_file file;
+	std::unique_ptr<uint8_t[]> buffer;
+	uint8_t const* table;
+
+	// Value k of pixel i is at c[k][i * stride].
+	void apply(uint8_t* const c[3], size_t stride, size_t length) const;
+};
+
+// "full" or "grid".
+color_lut::layout parse_layout(const std::string &name);
+
+// Maps the table from filename if it holds this conversion, otherwise builds
+// it and saves it there for the next run.
+color_lut open_lut(const std::string &filename, model from, model to, color_lut::layout kind, size_t threads = 0);
+
+}
+
+#endif
\ No newline at end of file
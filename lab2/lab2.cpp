@@ -1,11 +1,112 @@
 #include <iostream>
 #include <cstring>
+#include <memory>
+#include <vector>
 
+#include "../common/batch.h"
+#include "../common/parallel.h"
 #include "pnm_image.h"
+#include "color_convert.h"
+#include "matrix.h"
+
+using lab2::pnm_image;
+using lab2::model;
+using lab2::color_lut;
+using lab2::sampling;
+
+static void process(const std::string &input_filename, size_t num_input_files, const std::string &initial_color_model,
+	const std::string &output_filename, size_t num_output_files, const std::string &final_color_model, size_t band_rows, const color_lut* lut,
+	size_t threads, sampling chroma) {
+	std::vector<std::string> input_filenames;
+	if (num_input_files == 1) {
+		input_filenames.push_back(input_filename);
+	} else {
+		size_t pos = input_filename.find_last_of('.');
+		if (pos == std::string::npos) throw std::runtime_error("Incorrect name of file");
+		std::string pattern = input_filename.substr(0, pos);
+		std::string extension = input_filename.substr(pos);
+		for (size_t k = 1; k <= 3; k++) input_filenames.push_back(pattern + "_" + std::to_string(k) + extension);
+	}
+	if (band_rows != 0) {
+		if (num_output_files == 1) {
+			pnm_image::stream_to_file(input_filenames, initial_color_model, output_filename, final_color_model, band_rows, lut, threads);
+		} else {
+			size_t pos = output_filename.find_last_of('.');
+			if (pos == std::string::npos) throw std::runtime_error("Incorrect name of file");
+			pnm_image::stream_to_files(input_filenames, initial_color_model, output_filename.substr(0, pos), output_filename.substr(pos), final_color_model, band_rows, lut, threads, chroma);
+		}
+		return;
+	}
+	pnm_image image;
+	if (num_input_files == 1) {
+		image = std::move(pnm_image(input_filename, initial_color_model));
+	} else {
+		image = std::move(pnm_image(
+			pnm_image(input_filenames[0], initial_color_model),
+			pnm_image(input_filenames[1], initial_color_model),
+			pnm_image(input_filenames[2], initial_color_model)));
+	}
+	image.set_threads(threads);
+	if (lut != nullptr) image.convert(*lut);
+	if (num_output_files == 1) {
+		image.print_to_file(output_filename, final_color_model);
+	} else {
+		size_t pos = output_filename.find_last_of('.');
+		if (pos == std::string::npos) throw std::runtime_error("Incorrect name of file");
+		std::string pattern = output_filename.substr(0, pos);
+		std::string extension = output_filename.substr(pos);
+		image.print_to_files(pattern, extension, final_color_model, chroma);
+	}
+}
+
+// Checks every fixed point kernel against the double precision one on all
+// inputs. Fails if any of them is off by more than one.
+static int verify() {
+	unsigned worst = 0;
+	for (size_t i = 0; i < lab2::num_models; i++) {
+		for (size_t j = 0; j < lab2::num_models; j++) {
+			model from = static_cast<model>(i);
+			model to = static_cast<model>(j);
+			if (!lab2::is_fixed_point(from, to)) continue;
+			lab2::conversion_error error = lab2::verify_fixed_point(from, to);
+			std::cout << lab2::model_name(from) << " -> " << lab2::model_name(to) << ": max error " << error.max << ", "
+				<< error.mismatches << " of " << error.values << " values differ" << std::endl;
+			worst = std::max(worst, error.max);
+		}
+	}
+	return worst <= 1 ? 0 : 1;
+}
 
 int main(int argc, char* argv[]) {
-	const std::string input_format = "Input format: -f <initial color model> -t <final color model> -i <number of input files> <name of input file> -o <number of output files> <name of output file>";
-	if (argc != 11) {
+	const std::string input_format = "Input format: -f <initial color model> -t <final color model> -i <number of input files> <name of input file> -o <number of output files> <name of output file> [-j <threads>] [-b <band height>] [-l <full | grid> [-c <table file>]] [-s <4:4:4 | 4:2:2 | 4:2:0>]\n"
+		"          or: --batch <manifest or directory> <output directory> [-j <threads>] -f <initial color model> -t <final color model> -i <number of input files> -o <number of output files> [-b <band height>] [-l <full | grid> [-c <table file>]] [-s <4:4:4 | 4:2:2 | 4:2:0>]\n"
+		"          or: --verify\n"
+		"          or: --matrix [-r <repeats>] [-j <threads>] [-e <max error>] [<P6 image>...]";
+	if (argc == 2 && strcmp(argv[1], "--verify") == 0) {
+		try {
+			return verify();
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+	if (lab2::is_matrix(argc, argv)) {
+		try {
+			return lab2::run_matrix(lab2::parse_matrix(argc, argv));
+		} catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+	bool batch_mode = is_batch(argc, argv);
+	batch_options batch;
+	try {
+		if (batch_mode) batch = parse_batch(argc, argv);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	if (!batch_mode && argc < 11) {
 		std::cerr << input_format << std::endl;
 		return 1;
 	}
@@ -15,14 +116,22 @@ int main(int argc, char* argv[]) {
 	size_t num_input_files = 0;
 	std::string output_filename;
 	size_t num_output_files = 0;
-	for (size_t cur = 1; cur <= 10;) {
-		if (strcmp(argv[cur], "-f") == 0 && cur + 1 < 11) {
+	char const* band_height = nullptr;
+	char const* thread_count = nullptr;
+	char const* chroma_sampling = nullptr;
+	char const* lut_layout = nullptr;
+	char const* lut_filename = nullptr;
+	size_t const num_args = argc;
+	size_t const name_args = (batch_mode ? 0 : 1);
+	size_t cur = (batch_mode ? batch.first_arg : 1);
+	while (cur < num_args) {
+		if (strcmp(argv[cur], "-f") == 0 && cur + 1 < num_args) {
 			initial_color_model = argv[cur + 1];
 			cur += 2;
-		} else if (strcmp(argv[cur], "-t") == 0 && cur + 1 < 11) {
+		} else if (strcmp(argv[cur], "-t") == 0 && cur + 1 < num_args) {
 			final_color_model = argv[cur + 1];
 			cur += 2;
-		} else if (strcmp(argv[cur], "-i") == 0 && cur + 2 < 11) {
+		} else if (strcmp(argv[cur], "-i") == 0 && cur + 1 + name_args < num_args) {
 			if (argv[cur + 1][0] == '\0' || argv[cur + 1][1] != '\0') break;
 			if (argv[cur + 1][0] == '1') {
 				num_input_files = 1;
@@ -31,9 +140,9 @@ int main(int argc, char* argv[]) {
 			} else {
 				break;
 			}
-			input_filename = argv[cur + 2];
-			cur += 3;
-		} else if (strcmp(argv[cur], "-o") == 0 && cur + 2 < 11) {
+			if (!batch_mode) input_filename = argv[cur + 2];
+			cur += 2 + name_args;
+		} else if (strcmp(argv[cur], "-o") == 0 && cur + 1 + name_args < num_args) {
 			if (argv[cur + 1][0] == '\0' || argv[cur + 1][1] != '\0') break;
 			if (argv[cur + 1][0] == '1') {
 				num_output_files = 1;
@@ -42,39 +151,58 @@ int main(int argc, char* argv[]) {
 			} else {
 				break;
 			}
-			output_filename = argv[cur + 2];
-			cur += 3;
+			if (!batch_mode) output_filename = argv[cur + 2];
+			cur += 2 + name_args;
+		} else if (strcmp(argv[cur], "-j") == 0 && !batch_mode && cur + 1 < num_args) {
+			thread_count = argv[cur + 1];
+			cur += 2;
+		} else if (strcmp(argv[cur], "-b") == 0 && cur + 1 < num_args) {
+			band_height = argv[cur + 1];
+			cur += 2;
+		} else if (strcmp(argv[cur], "-s") == 0 && cur + 1 < num_args) {
+			chroma_sampling = argv[cur + 1];
+			cur += 2;
+		} else if (strcmp(argv[cur], "-l") == 0 && cur + 1 < num_args) {
+			lut_layout = argv[cur + 1];
+			cur += 2;
+		} else if (strcmp(argv[cur], "-c") == 0 && cur + 1 < num_args) {
+			lut_filename = argv[cur + 1];
+			cur += 2;
 		} else {
 			break;
 		}
 	}
-	if (initial_color_model == "" || final_color_model == "" || input_filename == "" || output_filename == "") {
+	if (cur != num_args || initial_color_model == "" || final_color_model == "" || num_input_files == 0 || num_output_files == 0
+		|| (!batch_mode && (input_filename == "" || output_filename == "")) || (lut_filename != nullptr && lut_layout == nullptr)) {
 		std::cerr << input_format << std::endl;
 		return 1;
 	}
 	try {
-		pnm_image image;
-		if (num_input_files == 1) {
-			image = std::move(pnm_image(input_filename, initial_color_model));
-		} else {
-			size_t pos = input_filename.find_last_of('.');
-			if (pos == std::string::npos) throw std::runtime_error("Incorrect name of file");
-			std::string pattern = input_filename.substr(0, pos);
-			std::string extension = input_filename.substr(pos);
-			image = std::move(pnm_image(
-				pnm_image((pattern + "_1" + extension), initial_color_model),
-				pnm_image((pattern + "_2" + extension), initial_color_model),
-				pnm_image((pattern + "_3" + extension), initial_color_model)));
+		size_t band_rows = (band_height != nullptr ? get_band_rows(band_height) : 0);
+		size_t threads = (thread_count != nullptr ? get_thread_count(thread_count) : 0);
+		sampling chroma = (chroma_sampling != nullptr ? lab2::parse_sampling(chroma_sampling) : sampling::s444);
+		if (chroma != sampling::s444 && num_output_files != 3) throw std::runtime_error("Only three output files can be subsampled");
+		// Built or mapped once, then shared by every image of the batch.
+		std::unique_ptr<color_lut> lut;
+		if (lut_layout != nullptr) {
+			model from = lab2::parse_model(initial_color_model);
+			model to = lab2::parse_model(final_color_model);
+			color_lut::layout kind = lab2::parse_layout(lut_layout);
+			if (lut_filename != nullptr) {
+				lut = std::make_unique<color_lut>(lab2::open_lut(lut_filename, from, to, kind, threads));
+			} else {
+				lut = std::make_unique<color_lut>(from, to, kind, threads);
+			}
 		}
-		if (num_output_files == 1) {
-			image.print_to_file(output_filename, final_color_model);
-		} else {
-			size_t pos = output_filename.find_last_of('.');
-			if (pos == std::string::npos) throw std::runtime_error("Incorrect name of file");
-			std::string pattern = output_filename.substr(0, pos);
-			std::string extension = output_filename.substr(pos);
-			image.print_to_files(pattern, extension, final_color_model);
+		if (batch_mode) {
+			if (num_input_files == 3) group_channel_inputs(batch);
+			// The batch already keeps every thread busy with its own image.
+			if (batch.threads > 1) threads = 1;
+			return run_batch(batch, "", [&](std::string const& input, std::string const& output) {
+				process(input, num_input_files, initial_color_model, output, num_output_files, final_color_model, band_rows, lut.get(), threads, chroma);
+			}) == 0 ? 0 : 1;
 		}
+		process(input_filename, num_input_files, initial_color_model, output_filename, num_output_files, final_color_model, band_rows, lut.get(), threads, chroma);
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
@@ -0,0 +1,214 @@
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include "../common/parallel.h"
+#include "matrix.h"
+#include "pnm_image.h"
+
+namespace lab2 {
+
+bool is_matrix(int argc, char* argv[]) {
+	return argc > 1 && strcmp(argv[1], "--matrix") == 0;
+}
+
+static size_t get_count(const char* arg, const char* message) {
+	try {
+		size_t index;
+		std::string value = arg;
+		if (value.empty() || value[0] == '-') throw std::runtime_error("");
+		size_t count = std::stoull(value, &index);
+		if (index != value.size()) throw std::runtime_error("");
+		return count;
+	} catch (...) {
+		throw std::runtime_error(message);
+	}
+}
+
+matrix_options parse_matrix(int argc, char* argv[]) {
+	matrix_options options;
+	int cur = 2;
+	for (; cur + 1 < argc && argv[cur][0] == '-'; cur += 2) {
+		if (strcmp(argv[cur], "-r") == 0) {
+			options.repeats = get_count(argv[cur + 1], "Number of repeats should be a positive integer");
+			if (options.repeats == 0) throw std::runtime_error("Number of repeats should be a positive integer");
+		} else if (strcmp(argv[cur], "-j") == 0) {
+			options.threads = get_thread_count(argv[cur + 1]);
+		} else if (strcmp(argv[cur], "-e") == 0) {
+			options.max_error = static_cast<int>(std::min<size_t>(get_count(argv[cur + 1], "Error budget should be a non-negative integer"), 255));
+		} else {
+			throw std::runtime_error(std::string("Unknown option ") + argv[cur]);
+		}
+	}
+	for (; cur < argc; cur++) options.images.push_back(argv[cur]);
+	return options;
+}
+
+// Absolute errors are counted in these buckets.
+static size_t const num_buckets = 8;
+static const char* const bucket_names[num_buckets] = {"0", "1", "2", "3", "4-7", "8-15", "16-31", "32+"};
+
+static size_t bucket(unsigned error) {
+	if (error < 4) return error;
+	size_t b = 4;
+	for (unsigned e = error >> 3; e != 0 && b < num_buckets - 1; e >>= 1) b++;
+	return b;
+}
+
+struct round_trip {
+	double seconds;
+	unsigned max = 0;
+	double mean = 0;
+	uint64_t histogram[num_buckets] = {};
+};
+
+struct matrix_image {
+	std::string name;
+	pnm_header header;
+	std::unique_ptr<uint8_t[]> pixels;
+};
+
+static std::unique_ptr<uint8_t[]> allocate(size_t length) {
+	try {
+		return std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+}
+
+static std::unique_ptr<uint8_t[]> copy_pixels(const pnm_header &header, const uint8_t* pixels) {
+	std::unique_ptr<uint8_t[]> copy = allocate(header.length());
+	memcpy(copy.get(), pixels, header.length());
+	return copy;
+}
+
+static std::unique_ptr<uint8_t[]> converted(const pnm_header &header, const uint8_t* pixels, model from, model to, size_t threads) {
+	pnm_image image(header, copy_pixels(header, pixels), model_name(from));
+	image.set_threads(threads);
+	image.convert(to);
+	return image.release();
+}
+
+// Every eighth-bit level of each channel, 0 and 255 included: 2^21 colours.
+static matrix_image make_cube() {
+	matrix_image image;
+	image.name = "RGB cube (128 levels)";
+	image.header.type = 3;
+	image.header.w = 2048;
+	image.header.h = 1024;
+	image.header.depth = 255;
+	image.pixels = allocate(image.header.length());
+	uint8_t* cur = image.pixels.get();
+	for (uint32_t i = 0; i < image.header.w * image.header.h; i++) {
+		*cur++ = static_cast<uint8_t>((i >> 14) * 255 / 127);
+		*cur++ = static_cast<uint8_t>((i >> 7 & 127) * 255 / 127);
+		*cur++ = static_cast<uint8_t>((i & 127) * 255 / 127);
+	}
+	return image;
+}
+
+// Diagonal gradients with a different phase per channel, like a photograph
+// mostly made of smooth regions.
+static matrix_image make_gradients() {
+	matrix_image image;
+	image.name = "gradients";
+	image.header.type = 3;
+	image.header.w = 1600;
+	image.header.h = 1200;
+	image.header.depth = 255;
+	image.pixels = allocate(image.header.length());
+	uint8_t* cur = image.pixels.get();
+	for (size_t y = 0; y < image.header.h; y++) {
+		for (size_t x = 0; x < image.header.w; x++) {
+			for (size_t k = 0; k < 3; k++) {
+				*cur++ = static_cast<uint8_t>((x * 255 / image.header.w + y * 255 / image.header.h) / 2 + k * 85);
+			}
+		}
+	}
+	return image;
+}
+
+static matrix_image load_image(const std::string &filename) {
+	pnm_image source(filename, "RGB");
+	matrix_image image;
+	image.name = filename;
+	image.header = source.header();
+	if (image.header.type != 3) throw std::runtime_error("Excepcted P6 file, found P5");
+	image.pixels = source.release();
+	return image;
+}
+
+// source holds the image in the from model. The conversion to is timed,
+// the result is converted back and both are compared in RGB.
+static round_trip measure(const pnm_header &header, const uint8_t* source, model from, model to, const matrix_options &options) {
+	round_trip result;
+	result.seconds = std::numeric_limits<double>::infinity();
+	std::unique_ptr<uint8_t[]> there;
+	for (size_t i = 0; i < options.repeats; i++) {
+		pnm_image image(header, copy_pixels(header, source), model_name(from));
+		image.set_threads(options.threads);
+		auto start = std::chrono::steady_clock::now();
+		image.convert(to);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		result.seconds = std::min(result.seconds, elapsed.count());
+		there = image.release();
+	}
+	std::unique_ptr<uint8_t[]> back = converted(header, there.get(), to, from, options.threads);
+	std::unique_ptr<uint8_t[]> expected = converted(header, source, from, model::RGB, options.threads);
+	std::unique_ptr<uint8_t[]> actual = converted(header, back.get(), from, model::RGB, options.threads);
+	uint64_t total = 0;
+	for (size_t i = 0; i < header.length(); i++) {
+		unsigned error = static_cast<unsigned>(std::abs(expected[i] - actual[i]));
+		result.max = std::max(result.max, error);
+		result.histogram[bucket(error)]++;
+		total += error;
+	}
+	result.mean = static_cast<double>(total) / header.length();
+	return result;
+}
+
+int run_matrix(const matrix_options &options) {
+	std::vector<matrix_image> images;
+	images.push_back(make_cube());
+	images.push_back(make_gradients());
+	for (const std::string &filename : options.images) images.push_back(load_image(filename));
+	bool failed = false;
+	for (const matrix_image &image : images) {
+		double megapixels = static_cast<double>(image.header.w) * image.header.h / 1e6;
+		std::cout << image.name << " (" << image.header.w << "x" << image.header.h << ")" << std::endl;
+		for (size_t i = 0; i < num_models; i++) {
+			model from = static_cast<model>(i);
+			std::unique_ptr<uint8_t[]> source = converted(image.header, image.pixels.get(), model::RGB, from, options.threads);
+			for (size_t j = 0; j < num_models; j++) {
+				model to = static_cast<model>(j);
+				round_trip result = measure(image.header, source.get(), from, to, options);
+				std::cout << std::fixed << "  " << std::setw(9) << model_name(from) << " -> " << std::setw(10) << std::left
+					<< model_name(to) << std::right << std::setw(10);
+				// Converting to the same model is a no-op, its time means nothing.
+				if (from == to) {
+					std::cout << "-";
+				} else {
+					std::cout << std::setprecision(1) << (result.seconds > 0 ? megapixels / result.seconds : 0);
+				}
+				std::cout << " MP/s, max " << std::setw(3) << result.max << ", mean " << std::setprecision(4) << result.mean
+					<< ", errors";
+				for (size_t b = 0; b < num_buckets; b++) {
+					if (result.histogram[b] == 0) continue;
+					std::cout << " " << bucket_names[b] << ": " << std::setprecision(2)
+						<< 100.0 * result.histogram[b] / image.header.length() << "%";
+				}
+				std::cout << std::endl;
+				if (options.max_error >= 0 && result.max > static_cast<unsigned>(options.max_error)) failed = true;
+			}
+		}
+	}
+	return failed ? 1 : 0;
+}
+
+}
\ No newline at end of file
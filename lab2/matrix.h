@@ -0,0 +1,31 @@
+#ifndef LAB2_MATRIX_H
+#define LAB2_MATRIX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lab2 {
+
+// Runs every one of the 7x7 conversions over two synthetic images (a
+// sampled RGB cube and smooth gradients) and the given P6 images. For each
+// pair the conversion is timed, and the image is taken back to the source
+// model: the round trip error is how far that moves the RGB pixels.
+struct matrix_options {
+	std::vector<std::string> images;
+	size_t repeats = 3;
+	size_t threads = 0;
+	// The run fails if any round trip is off by more, -1 means no budget.
+	int max_error = -1;
+};
+
+bool is_matrix(int argc, char* argv[]);
+
+matrix_options parse_matrix(int argc, char* argv[]);
+
+// Prints the matrix and returns 1 if the error budget is exceeded.
+int run_matrix(const matrix_options &options);
+
+}
+
+#endif
\ No newline at end of file
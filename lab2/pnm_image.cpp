@@ -3,495 +3,420 @@
 #include <string>
 #include <cctype>
 #include <exception>
-#include <cmath>
+#include <algorithm>
 
+#include "../common/parallel.h"
 #include "pnm_image.h"
 
-static uint32_t get_number(const char* s) {
-	char const* cur = s;
-	if (*cur == '\0') throw std::runtime_error("Incorrect format of file");
-	while (*cur != '\0') {
-		if (!std::isdigit(*cur)) throw std::runtime_error("Incorrect format of file");
-		cur++;
-	}
-	uint32_t num = std::stoul(s);
-	if (num == 0) throw std::runtime_error("Incorrect format of file");
-	return num;
-}
+namespace lab2 {
 
-static void check_model(const std::string& color_model) {
-	if (color_model != "RGB" && color_model != "HSL" && color_model != "HSV" 
-		&& color_model != "YCbCr.601" && color_model != "YCbCr.709" 
-		&& color_model != "YCoCg" && color_model != "CMY") {
-		throw std::runtime_error("Unsupported color model");
-	}
+pnm_image::pnm_image(const std::string &filename, const std::string &color_model) : color_model(parse_model(color_model)) {
+	file = pnm_file(filename);
+	pnm_header const& header = file.header();
+	type = header.type;
+	w = header.w;
+	h = header.h;
+	depth = header.depth;
+	data = file.pixels();
 }
 
-pnm_image::pnm_image(const std::string &filename, const std::string &color_model) : color_model(color_model) {
-	check_model(color_model);
-	std::ifstream input(filename, std::ios_base::binary);
-	if (input.fail()) throw std::runtime_error("Could not open input file");
-	char input_str[128];
-	input.get(input_str, 128, '\n');
-	if (strcmp(input_str, "P5") == 0) {
-		type = 1;
-	} else if (strcmp(input_str, "P6") == 0) {
-		type = 3;
-	} else {
-		throw std::runtime_error("Incorrect format of file, expected P5 or P6");
-	}
-	input.ignore();
-	input.get(input_str, 128, ' ');
-	w = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	h = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	depth = get_number(input_str);
-	size_t length = static_cast<size_t>(w) * h * type;
-	try {
-		data = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
-	} catch (...) {
-		throw std::runtime_error("Could not allocate memory");
+static void check_sampling(sampling chroma, model color_model) {
+	if (chroma != sampling::s444 && !has_chroma(color_model)) {
+		throw std::runtime_error("Chroma subsampling needs a YCbCr color model");
 	}
-	input.ignore();
-	input.read(reinterpret_cast<char*>(data.get()), length);
-	if (input.fail()) throw std::runtime_error("Incorrect format of file");
-	input.ignore();
-	if (!input.eof()) throw std::runtime_error("Incorrect format of file");
 }
 
-pnm_image::pnm_image(const pnm_image& first, const pnm_image& second, const pnm_image& third) : 
-	color_model(first.color_model), type(3), w(first.w), h(first.h), depth(first.depth) {
+pnm_image::pnm_image(pnm_image &&first, pnm_image &&second, pnm_image &&third) :
+	data(nullptr), color_model(first.color_model), type(3), w(first.w), h(first.h), depth(first.depth), planar(true) {
+	// The second and third files may be subsampled, which is told from their size.
+	sampling chroma = sampling::s444;
+	if (second.w != first.w || second.h != first.h) {
+		chroma = (second.h == first.h ? sampling::s422 : sampling::s420);
+	}
 	if (first.type != 1 || second.type != 1 || third.type != 1
-		|| first.w != second.w || second.w != third.w
-		|| first.h != second.h || second.h != third.h
+		|| second.w != chroma_width(chroma, w) || second.h != chroma_height(chroma, h)
+		|| second.w != third.w || second.h != third.h
 		|| first.depth != second.depth || second.depth != third.depth
 		|| first.color_model != second.color_model || second.color_model != third.color_model) {
 		throw std::runtime_error("Incorrect format of 3 files");
 	}
-	size_t length = static_cast<size_t>(w) * h;
-	try {
-		data = std::unique_ptr<uint8_t[]>(new uint8_t[length * 3]);
-	} catch (...) {
-		throw std::runtime_error("Could not allocate memory");
+	check_sampling(chroma, color_model);
+	pnm_image* sources[3] = {&first, &second, &third};
+	for (size_t k = 0; k < 3; k++) {
+		plane_files[k] = std::move(sources[k]->file);
+		plane_buffers[k] = std::move(sources[k]->buffer);
+		planes[k] = sources[k]->data;
+		sources[k]->data = nullptr;
+		if (k == 0 || chroma == sampling::s444) continue;
+		std::unique_ptr<uint8_t[]> full;
+		try {
+			full = std::unique_ptr<uint8_t[]>(new uint8_t[static_cast<size_t>(w) * h]);
+		} catch (...) {
+			throw std::runtime_error("Could not allocate memory");
+		}
+		upsample(chroma, planes[k], w, h, full.get());
+		plane_files[k] = pnm_file();
+		plane_buffers[k] = std::move(full);
+		planes[k] = plane_buffers[k].get();
 	}
-	uint8_t* f = first.data.get();
-	uint8_t* s = second.data.get();
-	uint8_t* t = third.data.get();
-	uint8_t* cur = data.get();
+}
+
+pnm_image::pnm_image(const pnm_header &header, std::unique_ptr<uint8_t[]> pixels, const std::string &color_model) :
+	buffer(std::move(pixels)), color_model(parse_model(color_model)), type(header.type), w(header.w), h(header.h), depth(header.depth) {
+	data = buffer.get();
+}
+
+pnm_header pnm_image::header() const {
+	pnm_header header;
+	header.type = type;
+	header.w = w;
+	header.h = h;
+	header.depth = depth;
+	return header;
+}
+
+// Rows are moved between the interleaved and the planar layout in bands of
+// about this many bytes, so that the image is never held twice.
+static size_t const layout_band_bytes = 1 << 20;
+
+static size_t layout_band_rows(uint32_t w) {
+	return std::max<size_t>(1, layout_band_bytes / (static_cast<size_t>(w) * 3));
+}
+
+static void interleave(uint8_t* const planes[3], size_t first, size_t length, uint8_t* ptr) {
+	uint8_t const* p0 = planes[0] + first;
+	uint8_t const* p1 = planes[1] + first;
+	uint8_t const* p2 = planes[2] + first;
 	for (size_t i = 0; i < length; i++) {
-		*(cur++) = *(f++);
-		*(cur++) = *(s++);
-		*(cur++) = *(t++);
+		ptr[3 * i] = p0[i];
+		ptr[3 * i + 1] = p1[i];
+		ptr[3 * i + 2] = p2[i];
 	}
 }
 
+static void deinterleave(uint8_t const* ptr, size_t k, size_t length, uint8_t* plane) {
+	for (size_t i = 0; i < length; i++) plane[i] = ptr[3 * i + k];
+}
+
+std::unique_ptr<uint8_t[]> pnm_image::release() {
+	if (planar) {
+		size_t length = static_cast<size_t>(w) * h;
+		try {
+			buffer = std::unique_ptr<uint8_t[]>(new uint8_t[length * 3]);
+		} catch (...) {
+			throw std::runtime_error("Could not allocate memory");
+		}
+		interleave(planes, 0, length, buffer.get());
+		for (size_t k = 0; k < 3; k++) {
+			plane_files[k] = pnm_file();
+			plane_buffers[k].reset();
+			planes[k] = nullptr;
+		}
+		planar = false;
+	} else if (!buffer) {
+		size_t length = static_cast<size_t>(w) * h * type;
+		try {
+			buffer = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+		} catch (...) {
+			throw std::runtime_error("Could not allocate memory");
+		}
+		memcpy(buffer.get(), data, length);
+		file = pnm_file();
+	}
+	data = nullptr;
+	return std::move(buffer);
+}
+
 void pnm_image::print_to_file(const std::string &filename, const std::string &color_model) {
 	convert(color_model);
-	std::ofstream output(filename, std::ios_base::binary);
-	if (!output.is_open()) throw std::runtime_error("Could not open file for writing");
-	output << "P6\n";
-	output << w << " " << h << "\n";
-	output << depth << "\n";
-	output.write(reinterpret_cast<char*>(data.get()), static_cast<size_t>(w) * h * 3);
-	if (output.fail()) {
-		output.close();
-		std::remove(filename.c_str());
-		throw std::runtime_error("Could not write to the file");
+	if (!planar) {
+		write_pnm(filename, header(), data);
+		return;
+	}
+	size_t band_rows = std::min<size_t>(layout_band_rows(w), h);
+	std::unique_ptr<uint8_t[]> band;
+	try {
+		band = std::unique_ptr<uint8_t[]>(new uint8_t[band_rows * w * 3]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	pnm_writer output(filename, header());
+	for (size_t y = 0; y < h; y += band_rows) {
+		size_t rows = std::min<size_t>(band_rows, h - y);
+		interleave(planes, y * w, rows * w, band.get());
+		output.write_rows(band.get(), rows);
 	}
+	output.close();
 }
 
-void pnm_image::print_to_files(const std::string &pattern, const std::string &extension, const std::string &color_model) {
+// The channel files are written by a thread each unless a single thread was asked for.
+static size_t writer_threads(size_t threads) {
+	return threads == 1 ? 1 : 3;
+}
+
+// Channels after the first are averaged down to the chroma resolution.
+static void write_channel(pnm_writer &output, size_t k, sampling chroma, const uint8_t* plane, size_t w, size_t rows,
+	uint8_t* samples) {
+	if (k == 0 || chroma == sampling::s444) {
+		output.write_rows(plane, rows);
+		return;
+	}
+	downsample(chroma, plane, w, rows, samples);
+	output.write_rows(samples, chroma_height(chroma, rows));
+}
+
+static pnm_header channel_header(pnm_header header, size_t k, sampling chroma) {
+	header.type = 1;
+	if (k != 0) {
+		header.w = static_cast<uint32_t>(chroma_width(chroma, header.w));
+		header.h = static_cast<uint32_t>(chroma_height(chroma, header.h));
+	}
+	return header;
+}
+
+void pnm_image::print_to_files(const std::string &pattern, const std::string &extension, const std::string &color_model,
+	sampling chroma) {
+	check_sampling(chroma, parse_model(color_model));
 	convert(color_model);
-	for (size_t k = 1; k <= 3; k++) {
-		std::string filename = pattern + "_" + std::to_string(k) + extension;
-		std::ofstream output(filename, std::ios_base::binary);
-		if (!output.is_open()) throw std::runtime_error("Could not open file for writing");
-		output << "P5\n";
-		output << w << " " << h << "\n";
-		output << depth << "\n";
-		char* ptr = reinterpret_cast<char*>(data.get()) + k - 1;
-		for (size_t i = 0; i < size_t(w) * h; i++) {
-			output.write(ptr, 1);
-			ptr += 3;
+	size_t band_rows = std::min<size_t>(chroma_band_rows(chroma, layout_band_rows(w)), h);
+	parallel_bands(3, static_cast<size_t>(w) * h, writer_threads(threads), [&](size_t begin, size_t end) {
+		std::unique_ptr<uint8_t[]> plane;
+		std::unique_ptr<uint8_t[]> samples;
+		try {
+			if (!planar) plane = std::unique_ptr<uint8_t[]>(new uint8_t[band_rows * w]);
+			samples = std::unique_ptr<uint8_t[]>(new uint8_t[chroma_width(chroma, w) * chroma_height(chroma, band_rows)]);
+		} catch (...) {
+			throw std::runtime_error("Could not allocate memory");
 		}
-		if (output.fail()) {
+		for (size_t k = begin; k < end; k++) {
+			if (planar && (k == 0 || chroma == sampling::s444)) {
+				write_pnm(pattern + "_" + std::to_string(k + 1) + extension, channel_header(header(), k, chroma), planes[k]);
+				continue;
+			}
+			pnm_writer output(pattern + "_" + std::to_string(k + 1) + extension, channel_header(header(), k, chroma));
+			for (size_t y = 0; y < h; y += band_rows) {
+				size_t rows = std::min<size_t>(band_rows, h - y);
+				const uint8_t* source = planes[k] + y * w;
+				if (!planar) {
+					deinterleave(data + y * w * 3, k, rows * w, plane.get());
+					source = plane.get();
+				}
+				write_channel(output, k, chroma, source, w, rows, samples.get());
+			}
 			output.close();
-			std::remove(filename.c_str());
-			throw std::runtime_error("Could not write to the file");
 		}
-	}
+	});
+}
+
+void pnm_image::set_threads(size_t count) {
+	threads = count;
+}
+
+// Converts length pixels in row bands over threads threads, through lut if
+// there is one.
+static void convert_band(model from, model to, const color_lut* lut, uint8_t* ptr, size_t length, size_t threads) {
+	if (lut == nullptr && from == to) return;
+	parallel_bands(length, 3, threads, [&](size_t begin, size_t end) {
+		if (lut != nullptr) {
+			lut->apply(ptr + 3 * begin, end - begin);
+		} else {
+			convert_pixels(from, to, ptr + 3 * begin, end - begin);
+		}
+	});
+}
+
+static void convert_band_planes(model from, model to, const color_lut* lut, uint8_t* const planes[3], size_t length, size_t threads) {
+	if (lut == nullptr && from == to) return;
+	parallel_bands(length, 3, threads, [&](size_t begin, size_t end) {
+		uint8_t* const band[3] = {planes[0] + begin, planes[1] + begin, planes[2] + begin};
+		if (lut != nullptr) {
+			lut->apply_planes(band, end - begin);
+		} else {
+			convert_planes(from, to, band, end - begin);
+		}
+	});
 }
 
 void pnm_image::convert(const std::string &color_model) {
-	check_model(color_model);
+	convert(parse_model(color_model));
+}
+
+void pnm_image::convert(model color_model) {
 	if (type != 3) throw std::runtime_error("Excepcted P6 file, found P5");
-	if (this->color_model == color_model) return;
-	convert_to_RGB();
-	convert_from_RGB(color_model);
+	if (planar) {
+		convert_band_planes(this->color_model, color_model, nullptr, planes, static_cast<size_t>(w) * h, threads);
+	} else {
+		convert_band(this->color_model, color_model, nullptr, data, static_cast<size_t>(w) * h, threads);
+	}
+	this->color_model = color_model;
 }
 
-static double mod(double a, double num) {
-	while (a < 0) a += num;
-	while (a >= num) a -= num;
-	return a;
+static void check_lut(const color_lut &lut, model from, model to) {
+	if (lut.from() != from || lut.to() != to) throw std::runtime_error("Lookup table does not match the conversion");
 }
 
-void pnm_image::convert_to_RGB() {
-	if (color_model == "RGB") return;
-	uint8_t* ptr = data.get();
-	size_t length = static_cast<size_t>(w) * h;
-	for (size_t i = 0; i < length; i++) {
-		if (color_model == "HSL") {
-			double H = static_cast<double>(*ptr) / 255 * 360;
-			if (H == 360) H = 0;
-			double S = static_cast<double>(*(ptr + 1)) / 255;
-			double L = static_cast<double>(*(ptr + 2)) / 255;
-			double C = (1 - std::abs(2 * L - 1)) * S;
-			double X = C * (1.0 - std::abs(mod(H / 60, 2) - 1.0));
-			double m = L - C / 2.0;
-			double r;
-			double g;
-			double b;
-			if (H < 60) {
-				r = C;
-				g = X;
-				b = 0;
-			} else if (H < 120) {
-				r = X;
-				g = C;
-				b = 0;
-			} else if (H < 180) {
-				r = 0;
-				g = C;
-				b = X;
-			} else if (H < 240) {
-				r = 0;
-				g = X;
-				b = C;
-			} else if (H < 300) {
-				r = X;
-				g = 0;
-				b = C;
-			} else {
-				r = C;
-				g = 0;
-				b = X;
-			}
-			r = (r + m) * 255;
-			g = (g + m) * 255;
-			b = (b + m) * 255;
-			if (r < 0) r = 0;
-			if (r > 255) r = 255;
-			if (g < 0) g = 0;
-			if (g > 255) g = 255;
-			if (b < 0) b = 0;
-			if (b > 255) b = 255;
-			uint8_t R = static_cast<uint8_t>(round(r));
-			uint8_t G = static_cast<uint8_t>(round(g));
-			uint8_t B = static_cast<uint8_t>(round(b));
-			*(ptr++) = R;
-			*(ptr++) = G;
-			*(ptr++) = B;
-		} else if (color_model == "HSV") {
-			double H = static_cast<double>(*ptr) / 255 * 360;
-			if (H == 360) H = 0;
-			double S = static_cast<double>(*(ptr + 1)) / 255;
-			double V = static_cast<double>(*(ptr + 2)) / 255;
-			double C = V * S;
-			double X = C * (1 - std::abs(mod(H / 60, 2) - 1));
-			double m = V - C;
-			double r;
-			double g;
-			double b;
-			if (H < 60) {
-				r = C;
-				g = X;
-				b = 0;
-			} else if (H < 120) {
-				r = X;
-				g = C;
-				b = 0;
-			} else if (H < 180) {
-				r = 0;
-				g = C;
-				b = X;
-			} else if (H < 240) {
-				r = 0;
-				g = X;
-				b = C;
-			} else if (H < 300) {
-				r = X;
-				g = 0;
-				b = C;
-			} else {
-				r = C;
-				g = 0;
-				b = X;
+void pnm_image::convert(const color_lut &lut) {
+	if (type != 3) throw std::runtime_error("Excepcted P6 file, found P5");
+	check_lut(lut, color_model, lut.to());
+	if (planar) {
+		convert_band_planes(color_model, lut.to(), &lut, planes, static_cast<size_t>(w) * h, threads);
+	} else {
+		convert_band(color_model, lut.to(), &lut, data, static_cast<size_t>(w) * h, threads);
+	}
+	color_model = lut.to();
+}
+
+// The input of a streamed conversion: one P6 file, or three P5 files whose
+// matching rows are read together. Only band_rows rows are ever held, as
+// pixels for the first and as planes for the second, and converted to the
+// other layout only when the output needs it.
+struct band_input {
+	pnm_header header;
+	bool planar;
+	size_t band_rows;
+	size_t threads;
+	std::unique_ptr<pnm_reader> readers[3];
+	sampling chroma = sampling::s444;
+	std::unique_ptr<uint8_t[]> band;
+	std::unique_ptr<uint8_t[]> planes[3];
+	std::unique_ptr<uint8_t[]> samples[3];
+
+	band_input(const std::vector<std::string> &filenames, model color_model, size_t band_rows, size_t threads);
+
+	size_t read();
+
+	void convert(model from, model to, const color_lut* lut, size_t rows);
+
+	const uint8_t* pixels(size_t rows);
+
+	const uint8_t* plane(size_t k, size_t rows);
+};
+
+band_input::band_input(const std::vector<std::string> &filenames, model color_model, size_t band_rows, size_t threads) :
+	planar(filenames.size() == 3), threads(threads) {
+	if (filenames.size() != 1 && filenames.size() != 3) throw std::runtime_error("Expected 1 or 3 input files");
+	for (size_t k = 0; k < filenames.size(); k++) readers[k] = std::make_unique<pnm_reader>(filenames[k]);
+	header = readers[0]->header();
+	if (!planar) {
+		if (header.type != 3) throw std::runtime_error("Excepcted P6 file, found P5");
+	} else {
+		pnm_header const& second = readers[1]->header();
+		pnm_header const& third = readers[2]->header();
+		if (second.w != header.w || second.h != header.h) {
+			chroma = (second.h == header.h ? sampling::s422 : sampling::s420);
+		}
+		if (header.type != 1 || second.type != 1 || third.type != 1
+			|| second.w != chroma_width(chroma, header.w) || second.h != chroma_height(chroma, header.h)
+			|| second.w != third.w || second.h != third.h
+			|| header.depth != second.depth || second.depth != third.depth) {
+			throw std::runtime_error("Incorrect format of 3 files");
+		}
+		check_sampling(chroma, color_model);
+		// Upsampling 4:2:0 needs the chroma rows on both sides of a band.
+		if (chroma == sampling::s420) throw std::runtime_error("4:2:0 files cannot be read by bands");
+		header.type = 3;
+	}
+	this->band_rows = std::min<size_t>(band_rows, header.h);
+	size_t length = this->band_rows * header.w;
+	try {
+		band = std::unique_ptr<uint8_t[]>(new uint8_t[length * 3]);
+		for (size_t k = 0; k < 3; k++) planes[k] = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+		if (chroma != sampling::s444) {
+			for (size_t k = 1; k < 3; k++) {
+				samples[k] = std::unique_ptr<uint8_t[]>(new uint8_t[chroma_width(chroma, header.w) * this->band_rows]);
 			}
-			r = (r + m) * 255;
-			g = (g + m) * 255;
-			b = (b + m) * 255;
-			if (r < 0) r = 0;
-			if (r > 255) r = 255;
-			if (g < 0) g = 0;
-			if (g > 255) g = 255;
-			if (b < 0) b = 0;
-			if (b > 255) b = 255;
-			uint8_t R = static_cast<uint8_t>(round(r));
-			uint8_t G = static_cast<uint8_t>(round(g));
-			uint8_t B = static_cast<uint8_t>(round(b));
-			*(ptr++) = R;
-			*(ptr++) = G;
-			*(ptr++) = B;
-		} else if (color_model == "YCbCr.601") {
-			double Y = static_cast<double>(*ptr);
-			double Cb = static_cast<double>(*(ptr + 1));
-			double Cr = static_cast<double>(*(ptr + 2));
-			double r = Y + (Cr - 128) * 1.402;
-			double g = Y - (Cb - 128) * 0.344136 - (Cr - 128) * 0.714136;
-			double b = Y + (Cb - 128) * 1.772;
-			if (r < 0) r = 0;
-			if (r > 255) r = 255;
-			if (g < 0) g = 0;
-			if (g > 255) g = 255;
-			if (b < 0) b = 0;
-			if (b > 255) b = 255;
-			uint8_t R = static_cast<uint8_t>(round(r));
-			uint8_t G = static_cast<uint8_t>(round(g));
-			uint8_t B = static_cast<uint8_t>(round(b));
-			*(ptr++) = R;
-			*(ptr++) = G;
-			*(ptr++) = B;
-		} else if (color_model == "YCbCr.709") {
-			double Y = static_cast<double>(*ptr);
-			double Cb = static_cast<double>(*(ptr + 1));
-			double Cr = static_cast<double>(*(ptr + 2));
-			double y = (Y / 255 * 219) + 16;
-			double cb = (Cb / 255 * 224) + 16;
-			double cr = (Cr / 255 * 224) + 16;
-			double r = y + (cr - 128) * 1.539648;
-			double g = y - (cb - 128) * 0.1831429 - (cr - 128) * 0.457675;
-			double b = y + (cb - 128) * 1.81418;
-			if (r < 16) r = 16;
-			if (r > 235) r = 235;
-			if (g < 16) g = 16;
-			if (g > 235) g = 235;
-			if (b < 16) b = 16;
-			if (b > 235) b = 235;
-			r = (r - 16) / 219 * 255;
-			g = (g - 16) / 219 * 255;
-			b = (b - 16) / 219 * 255;
-			uint8_t R = static_cast<uint8_t>(round(r));
-			uint8_t G = static_cast<uint8_t>(round(g));
-			uint8_t B = static_cast<uint8_t>(round(b));
-			*(ptr++) = R;
-			*(ptr++) = G;
-			*(ptr++) = B;
-		} else if (color_model == "YCoCg") {
-			double Y = static_cast<double>(*ptr);
-			double Co = static_cast<double>(*(ptr + 1));
-			double Cg = static_cast<double>(*(ptr + 2));
-			double y = Y / 255;
-			double co = Co / 255 - 0.5;
-			double cg = Cg / 255 - 0.5;
-			double r = y + co - cg;
-			double g = y + cg;
-			double b = y - co - cg;
-			r *= 255;
-			g *= 255;
-			b *= 255;
-			if (r < 0) r = 0;
-			if (r > 255) r = 255;
-			if (g < 0) g = 0;
-			if (g > 255) g = 255;
-			if (b < 0) b = 0;
-			if (b > 255) b = 255;
-			uint8_t R = static_cast<uint8_t>(round(r));
-			uint8_t G = static_cast<uint8_t>(round(g));
-			uint8_t B = static_cast<uint8_t>(round(b));
-			*(ptr++) = R;
-			*(ptr++) = G;
-			*(ptr++) = B;
-		} else if (color_model == "CMY") {
-			uint8_t c = *ptr;
-			uint8_t m = *(ptr + 1);
-			uint8_t y = *(ptr + 2);
-			uint8_t r = 255 - c;
-			uint8_t g = 255 - m;
-			uint8_t b = 255 - y;
-			*(ptr++) = r;
-			*(ptr++) = g;
-			*(ptr++) = b;
 		}
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
 	}
 }
 
-void pnm_image::convert_from_RGB(const std::string &color_model) {
-	if (color_model == "RGB") return;
-	uint8_t* ptr = data.get();
-	size_t length = static_cast<size_t>(w) * h;
-	for (size_t i = 0; i < length; i++) {
-		if (color_model == "HSL") {
-			uint8_t R = *ptr;
-			uint8_t G = *(ptr + 1);
-			uint8_t B = *(ptr + 2);
-			double r = static_cast<double>(R) / 255;
-			double g = static_cast<double>(G) / 255;
-			double b = static_cast<double>(B) / 255;
-			double cmax = std::max(std::max(r, g), b);
-			double cmin = std::min(std::min(r, g), b);
-			double delta = cmax - cmin;
-			double H;
-			double S;
-			double L = (cmax + cmin) / 2;
-			if (delta == 0) {
-				H = 0;
-			} else if (r == cmax) {
-				H = 60 * mod((g - b) / delta, 6);
-			} else if (g == cmax) {
-				H = 60 * ((b - r) / delta + 2);
-			} else {
-				H = 60 * ((r - g) / delta + 4);
-			}
-			if (delta == 0) {
-				S = 0;
-			} else {
-				S = delta / (1 - std::abs(2 * L - 1));
-			}
-			H = mod(H, 360);
-			H = H / 360 * 255;
-			S *= 255;
-			L *= 255;
-			if (S < 0) S = 0;
-			if (S > 255) S = 255;
-			if (L < 0) L = 0;
-			if (L > 255) L = 255;
-			uint8_t h = static_cast<uint8_t>(round(H));
-			uint8_t s = static_cast<uint8_t>(round(S));
-			uint8_t l = static_cast<uint8_t>(round(L));
-			*(ptr++) = h;
-			*(ptr++) = s;
-			*(ptr++) = l;
-		} else if (color_model == "HSV") {
-			uint8_t R = *ptr;
-			uint8_t G = *(ptr + 1);
-			uint8_t B = *(ptr + 2);
-			double r = static_cast<double>(R) / 255;
-			double g = static_cast<double>(G) / 255;
-			double b = static_cast<double>(B) / 255;
-			double cmax = std::max(std::max(r, g), b);
-			double cmin = std::min(std::min(r, g), b);
-			double delta = cmax - cmin;
-			double H;
-			double S;
-			double V = cmax;
-			if (delta == 0) {
-				H = 0;
-			} else if (r == cmax) {
-				H = 60 * mod((g - b) / delta, 6);
-			} else if (g == cmax) {
-				H = 60 * ((b - r) / delta + 2);
+size_t band_input::read() {
+	if (!planar) return readers[0]->read_rows(band.get(), band_rows);
+	size_t rows[3] = {0, 0, 0};
+	parallel_bands(3, band_rows * header.w, writer_threads(threads), [&](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; k++) {
+			if (k == 0 || chroma == sampling::s444) {
+				rows[k] = readers[k]->read_rows(planes[k].get(), band_rows);
 			} else {
-				H = 60 * ((r - g) / delta + 4);
+				rows[k] = readers[k]->read_rows(samples[k].get(), band_rows);
+				upsample(chroma, samples[k].get(), header.w, rows[k], planes[k].get());
 			}
-			if (cmax == 0) {
-				S = 0;
-			} else {
-				S = delta / cmax;
-			}
-			H = mod(H, 360);
-			H = H / 360 * 255;
-			S *= 255;
-			V *= 255;
-			if (S < 0) S = 0;
-			if (S > 255) S = 255;
-			if (V < 0) V = 0;
-			if (V > 255) V = 255;
-			uint8_t h = static_cast<uint8_t>(round(H));
-			uint8_t s = static_cast<uint8_t>(round(S));
-			uint8_t v = static_cast<uint8_t>(round(V));
-			*(ptr++) = h;
-			*(ptr++) = s;
-			*(ptr++) = v;
-		} else if (color_model == "YCbCr.601") {
-			uint8_t R = *ptr;
-			uint8_t G = *(ptr + 1);
-			uint8_t B = *(ptr + 2);
-			double r = static_cast<double>(R);
-			double g = static_cast<double>(G);
-			double b = static_cast<double>(B);
-			double Y = 0.299 * r + 0.587 * g + 0.114 * b;
-			double Cb = 128 - 0.168736 * r - 0.331264 * g + 0.5 * b;
-			double Cr = 128 + 0.5 * r - 0.418688 * g - 0.081312 * b;
-			if (Y < 0) Y = 0;
-			if (Y > 255) Y = 255;
-			if (Cb < 0) Cb = 0;
-			if (Cb > 255) Cb = 255;
-			if (Cr < 0) Cr = 0;
-			if (Cr > 255) Cr = 255;
-			uint8_t y = static_cast<uint8_t>(round(Y));
-			uint8_t cb = static_cast<uint8_t>(round(Cb));
-			uint8_t cr = static_cast<uint8_t>(round(Cr));
-			*(ptr++) = y;
-			*(ptr++) = cb;
-			*(ptr++) = cr;
-		} else if (color_model == "YCbCr.709") {
-			uint8_t R = *ptr;
-			uint8_t G = *(ptr + 1);
-			uint8_t B = *(ptr + 2);
-			double r = static_cast<double>(R);
-			double g = static_cast<double>(G);
-			double b = static_cast<double>(B);
-			double Y = (46.742 * r + 157.243 * g + 15.874 * b) / 256 + 16;
-			double Cb = (-25.765 * r - 86.674 * g + 112.439 * b) / 256 + 128;
-			double Cr = (112.439 * r - 102.129 * g - 10.310 * b) / 256 + 128;
-			Y = (Y - 16) / 219 * 255;
-			Cb = (Cb - 16) / 224 * 255;
-			Cr = (Cr - 16) / 224 * 255;
-			if (Y < 0) Y = 0;
-			if (Y > 255) Y = 255;
-			if (Cb < 0) Cb = 0;
-			if (Cb > 255) Cb = 255;
-			if (Cr < 0) Cr = 0;
-			if (Cr > 255) Cr = 255;
-			uint8_t y = static_cast<uint8_t>(round(Y));
-			uint8_t cb = static_cast<uint8_t>(round(Cb));
-			uint8_t cr = static_cast<uint8_t>(round(Cr));
-			*(ptr++) = y;
-			*(ptr++) = cb;
-			*(ptr++) = cr;
-		} else if (color_model == "YCoCg") {
-			uint8_t R = *ptr;
-			uint8_t G = *(ptr + 1);
-			uint8_t B = *(ptr + 2);
-			double r = static_cast<double>(R) / 255;
-			double g = static_cast<double>(G) / 255;
-			double b = static_cast<double>(B) / 255;
-			double y = 0.25 * r + 0.5 * g + 0.25 * b;
-			double co = 0.5 * r - 0.5 * b;
-			double cr = -0.25 * r + 0.5 * g - 0.25 * b;
-			y *= 255;
-			co = (co + 0.5) * 255;
-			cr = (cr + 0.5) * 255;
-			uint8_t Y = static_cast<uint8_t>(round(y));
-			uint8_t Co = static_cast<uint8_t>(round(co));
-			uint8_t Cr = static_cast<uint8_t>(round(cr));
-			*(ptr++) = Y;
-			*(ptr++) = Co;
-			*(ptr++) = Cr;
-		} else if (color_model == "CMY") {
-			uint8_t r = *ptr;
-			uint8_t g = *(ptr + 1);
-			uint8_t b = *(ptr + 2);
-			uint8_t c = 255 - r;
-			uint8_t m = 255 - g;
-			uint8_t y = 255 - b;
-			*(ptr++) = c;
-			*(ptr++) = m;
-			*(ptr++) = y;
 		}
+	});
+	return rows[0];
+}
+
+void band_input::convert(model from, model to, const color_lut* lut, size_t rows) {
+	if (planar) {
+		uint8_t* const band_planes[3] = {planes[0].get(), planes[1].get(), planes[2].get()};
+		convert_band_planes(from, to, lut, band_planes, rows * header.w, threads);
+	} else {
+		convert_band(from, to, lut, band.get(), rows * header.w, threads);
+	}
+}
+
+const uint8_t* band_input::pixels(size_t rows) {
+	if (planar) {
+		uint8_t* const band_planes[3] = {planes[0].get(), planes[1].get(), planes[2].get()};
+		interleave(band_planes, 0, rows * header.w, band.get());
 	}
+	return band.get();
+}
+
+const uint8_t* band_input::plane(size_t k, size_t rows) {
+	if (!planar) deinterleave(band.get(), k, rows * header.w, planes[k].get());
+	return planes[k].get();
+}
+
+void pnm_image::stream_to_file(const std::vector<std::string> &input_filenames, const std::string &initial_model,
+	const std::string &filename, const std::string &color_model, size_t band_rows, const color_lut* lut, size_t threads) {
+	model from = parse_model(initial_model);
+	model to = parse_model(color_model);
+	if (lut != nullptr) check_lut(*lut, from, to);
+	band_input input(input_filenames, from, band_rows, threads);
+	pnm_writer output(filename, input.header);
+	size_t rows;
+	while ((rows = input.read()) != 0) {
+		input.convert(from, to, lut, rows);
+		output.write_rows(input.pixels(rows), rows);
+	}
+	output.close();
+}
+
+void pnm_image::stream_to_files(const std::vector<std::string> &input_filenames, const std::string &initial_model,
+	const std::string &pattern, const std::string &extension, const std::string &color_model, size_t band_rows,
+	const color_lut* lut, size_t threads, sampling chroma) {
+	model from = parse_model(initial_model);
+	model to = parse_model(color_model);
+	if (lut != nullptr) check_lut(*lut, from, to);
+	check_sampling(chroma, to);
+	band_input input(input_filenames, from, chroma_band_rows(chroma, band_rows), threads);
+	size_t w = input.header.w;
+	std::unique_ptr<uint8_t[]> samples[3];
+	try {
+		for (size_t k = 1; k < 3; k++) {
+			samples[k] = std::unique_ptr<uint8_t[]>(new uint8_t[chroma_width(chroma, w) * chroma_height(chroma, input.band_rows)]);
+		}
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	pnm_writer first(pattern + "_1" + extension, channel_header(input.header, 0, chroma));
+	pnm_writer second(pattern + "_2" + extension, channel_header(input.header, 1, chroma));
+	pnm_writer third(pattern + "_3" + extension, channel_header(input.header, 2, chroma));
+	pnm_writer* outputs[3] = { &first, &second, &third };
+	size_t rows;
+	while ((rows = input.read()) != 0) {
+		input.convert(from, to, lut, rows);
+		parallel_bands(3, rows * w, writer_threads(threads), [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++) {
+				write_channel(*outputs[k], k, chroma, input.plane(k, rows), w, rows, samples[k].get());
+			}
+		});
+	}
+	first.close();
+	second.close();
+	third.close();
+}
+
 }
\ No newline at end of file
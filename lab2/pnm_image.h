@@ -1,15 +1,28 @@
-#ifndef PNM_IMAGE_H
-#define PNM_IMAGE_H
+#ifndef LAB2_PNM_IMAGE_H
+#define LAB2_PNM_IMAGE_H
 
 #include <memory>
 #include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../common/pnm_io.h"
+#include "color_convert.h"
+#include "color_lut.h"
+#include "chroma.h"
+
+namespace lab2 {
 
 struct pnm_image {
-	pnm_image() : type(0), w(0), h(0), depth(0) {}
+	pnm_image() : data(nullptr), color_model(model::RGB), type(0), w(0), h(0), depth(0) {}
 
 	pnm_image(const std::string &filename, const std::string &color_model);
 
-	pnm_image(const pnm_image &first, const pnm_image &second, const pnm_image &third);
+	// Takes three P5 images over as the planes of one image, nothing is copied
+	// unless the second and third are subsampled, then they are upsampled.
+	pnm_image(pnm_image &&first, pnm_image &&second, pnm_image &&third);
+
+	pnm_image(const pnm_header &header, std::unique_ptr<uint8_t[]> pixels, const std::string &color_model);
 
 	pnm_image(const pnm_image&) = delete;
 
@@ -21,20 +34,56 @@ struct pnm_image {
 	 
 	void print_to_file(const std::string &filename, const std::string &color_model);
 
-	void print_to_files(const std::string &pattern, const std::string &extension, const std::string &color_model);
+	// The second and third files of a YCbCr image can be written subsampled.
+	void print_to_files(const std::string &pattern, const std::string &extension, const std::string &color_model,
+		sampling chroma = sampling::s444);
+
+	void convert(const std::string &color_model);
+
+	void convert(model color_model);
+
+	// Converts through the table instead of the kernels, the image has to be
+	// in the model the table converts from.
+	void convert(const color_lut &lut);
+
+	// Conversion is split into row bands over this many threads, 0 means one
+	// per hardware thread. The three channel files are written concurrently
+	// unless this is 1.
+	void set_threads(size_t count);
+
+	pnm_header header() const;
+
+	std::unique_ptr<uint8_t[]> release();
+
+	// Converts the image band_rows rows at a time without loading it whole,
+	// through lut if it is given, each band over threads threads. The input
+	// is one P6 file or three P5 files, whose matching bands are merged; the
+	// second and third of these can be 4:2:2 but not 4:2:0.
+	static void stream_to_file(const std::vector<std::string> &input_filenames, const std::string &initial_model,
+		const std::string &filename, const std::string &color_model, size_t band_rows, const color_lut* lut = nullptr,
+		size_t threads = 0);
+
+	static void stream_to_files(const std::vector<std::string> &input_filenames, const std::string &initial_model,
+		const std::string &pattern, const std::string &extension, const std::string &color_model, size_t band_rows,
+		const color_lut* lut = nullptr, size_t threads = 0, sampling chroma = sampling::s444);
 
 private:
-	std::unique_ptr<uint8_t[]> data;
-	std::string color_model;
+	pnm_file file;
+	std::unique_ptr<uint8_t[]> buffer;
+	uint8_t* data;
+	model color_model;
 	uint32_t type;
 	uint32_t w, h;
 	uint16_t depth;
-
-	void convert(const std::string &color_model);
-
-	void convert_to_RGB();
-
-	void convert_from_RGB(const std::string &color_model);
+	size_t threads = 0;
+	// Images made of three P5 files keep them as three planes rather than
+	// interleaving them, data is not used then.
+	bool planar = false;
+	pnm_file plane_files[3];
+	std::unique_ptr<uint8_t[]> plane_buffers[3];
+	uint8_t* planes[3] = {nullptr, nullptr, nullptr};
 };
 
-#endif
+}
+
+#endif
\ No newline at end of file
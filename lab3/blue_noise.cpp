@@ -0,0 +1,236 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <exception>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "../common/atomic_file.h"
+#include "blue_noise.h"
+
+namespace lab3 {
+
+// File layout: the table header with the side of the mask as parameter, then
+// the ranks row by row in the byte order of the machine that made them.
+static char const magic[8] = {'L', 'A', 'B', '3', 'B', 'N', 'M', '1'};
+
+static size_t const cells = blue_noise_mask::size * blue_noise_mask::size;
+
+// Width of the Gaussian that measures how crowded a cell is, 1.5 as in the paper.
+static double const sigma = 1.5;
+
+// Minority pixels of the initial pattern, one cell in ten.
+static size_t const initial_points = cells / 10;
+
+// Every cell holds the sum of the Gaussian over the points set, the torus
+// wrapping around so that the mask tiles without seams.
+struct energy_field {
+	std::vector<double> weight;
+	std::vector<double> energy;
+	std::vector<bool> points;
+
+	energy_field() : weight(cells), energy(cells, 0), points(cells, false) {
+		size_t const n = blue_noise_mask::size;
+		for (size_t dy = 0; dy < n; dy++) {
+			for (size_t dx = 0; dx < n; dx++) {
+				double y = static_cast<double>(std::min(dy, n - dy));
+				double x = static_cast<double>(std::min(dx, n - dx));
+				weight[dy * n + dx] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+			}
+		}
+	}
+
+	void toggle(size_t cell) {
+		size_t const n = blue_noise_mask::size;
+		points[cell] = !points[cell];
+		double sign = points[cell] ? 1 : -1;
+		size_t cy = cell / n, cx = cell % n;
+		for (size_t y = 0; y < n; y++) {
+			double const* row = weight.data() + ((y + n - cy) % n) * n;
+			for (size_t x = 0; x < n; x++) energy[y * n + x] += sign * row[(x + n - cx) % n];
+		}
+	}
+
+	// The most crowded point.
+	size_t tightest_cluster() const {
+		size_t best = cells;
+		for (size_t i = 0; i < cells; i++) {
+			if (points[i] && (best == cells || energy[i] > energy[best])) best = i;
+		}
+		return best;
+	}
+
+	// The emptiest cell without a point.
+	size_t largest_void() const {
+		size_t best = cells;
+		for (size_t i = 0; i < cells; i++) {
+			if (!points[i] && (best == cells || energy[i] < energy[best])) best = i;
+		}
+		return best;
+	}
+};
+
+blue_noise_mask::blue_noise_mask() {
+	try {
+		ranks = std::unique_ptr<uint16_t[]>(new uint16_t[cells]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	energy_field field;
+	// A fixed seed: the mask does not change between runs.
+	std::vector<size_t> order(cells);
+	std::iota(order.begin(), order.end(), 0);
+	std::shuffle(order.begin(), order.end(), std::mt19937(1));
+	for (size_t i = 0; i < initial_points; i++) field.toggle(order[i]);
+	// Moves the most crowded point to the emptiest cell until that is where it
+	// came from.
+	for (size_t step = 0; step < cells; step++) {
+		size_t cluster = field.tightest_cluster();
+		field.toggle(cluster);
+		size_t found = field.largest_void();
+		field.toggle(found);
+		if (found == cluster) break;
+	}
+	std::vector<bool> prototype = field.points;
+	// The points of the prototype get the low ranks, the most crowded one
+	// removed first taking the highest of them.
+	energy_field removing = field;
+	for (size_t rank = initial_points; rank-- > 0;) {
+		size_t cluster = removing.tightest_cluster();
+		removing.toggle(cluster);
+		ranks[cluster] = static_cast<uint16_t>(rank);
+	}
+	// The rest fill the emptiest cell one at a time. Past half the mask this is
+	// also the tightest cluster of the cells left, as their energy is the
+	// total minus the one of the points.
+	for (size_t rank = initial_points; rank < cells; rank++) {
+		size_t found = field.largest_void();
+		field.toggle(found);
+		ranks[found] = static_cast<uint16_t>(rank);
+	}
+}
+
+static size_t const file_size = table_header_size + cells * sizeof(uint16_t);
+
+// The whole file, which has to be file_size bytes. The mask is small, so it
+// is copied rather than mapped: nothing done to the file later can reach it.
+static void read_mask_file(std::string const& filename, uint8_t* data) {
+#ifdef _WIN32
+	std::ifstream input(filename, std::ios_base::binary);
+	if (input.fail()) throw std::runtime_error("Could not open input file");
+	input.read(reinterpret_cast<char*>(data), file_size);
+	if (input.fail() || input.peek() != std::ifstream::traits_type::eof()) throw std::runtime_error("Incorrect format of blue noise mask");
+#else
+	int input = open(filename.c_str(), O_RDONLY | O_NOFOLLOW);
+	if (input < 0) throw std::runtime_error("Could not open input file");
+	struct stat st;
+	bool trusted = fstat(input, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == geteuid()
+		&& (st.st_mode & (S_IWGRP | S_IWOTH)) == 0 && static_cast<size_t>(st.st_size) == file_size;
+	size_t done = 0;
+	while (trusted && done < file_size) {
+		ssize_t count = read(input, data + done, file_size - done);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) break;
+		done += count;
+	}
+	close(input);
+	if (!trusted || done != file_size) throw std::runtime_error("Incorrect format of blue noise mask");
+#endif
+}
+
+blue_noise_mask::blue_noise_mask(std::string const& filename) {
+	std::vector<uint8_t> data(file_size);
+	read_mask_file(filename, data.data());
+	uint8_t const* params = table_params(data.data(), data.size(), magic);
+	if (params == nullptr || params[0] != blue_noise_mask::size) throw std::runtime_error("Incorrect format of blue noise mask");
+	try {
+		ranks = std::unique_ptr<uint16_t[]>(new uint16_t[cells]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	memcpy(ranks.get(), data.data() + table_header_size, cells * sizeof(uint16_t));
+	// A file left by someone else must still hold every rank once.
+	std::vector<bool> seen(cells, false);
+	for (size_t i = 0; i < cells; i++) {
+		if (ranks[i] >= cells || seen[ranks[i]]) throw std::runtime_error("Incorrect format of blue noise mask");
+		seen[ranks[i]] = true;
+	}
+}
+
+void blue_noise_mask::save(std::string const& filename) const {
+	uint8_t const params[1] = {static_cast<uint8_t>(blue_noise_mask::size)};
+	save_table(filename, magic, params, sizeof(params), ranks.get(), cells * sizeof(uint16_t));
+}
+
+static bool any_mask(blue_noise_mask const&) {
+	return true;
+}
+
+blue_noise_mask open_blue_noise(std::string const& filename) {
+	return open_cached<blue_noise_mask>(filename, any_mask, []() { return blue_noise_mask(); });
+}
+
+#ifndef _WIN32
+// A directory of the user that nobody else can write, created if missing.
+static bool private_directory(std::string const& path) {
+	if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) return false;
+	struct stat st;
+	return lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+#endif
+
+// Empty if the user has no cache directory that can be trusted.
+static std::string cache_directory() {
+	std::filesystem::path base;
+#ifdef _WIN32
+	char const* local = std::getenv("LOCALAPPDATA");
+	if (local == nullptr || *local == '\0') return "";
+	base = local;
+#else
+	char const* xdg = std::getenv("XDG_CACHE_HOME");
+	char const* home = std::getenv("HOME");
+	if (xdg != nullptr && *xdg == '/') {
+		base = xdg;
+	} else if (home != nullptr && *home == '/') {
+		base = std::filesystem::path(home) / ".cache";
+	} else {
+		return "";
+	}
+#endif
+	std::filesystem::path directory = base / "lab3";
+#ifdef _WIN32
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error) return "";
+#else
+	if (!private_directory(base.string()) || !private_directory(directory.string())) return "";
+#endif
+	return directory.string();
+}
+
+static blue_noise_mask open_cached_blue_noise() {
+	std::string directory = cache_directory();
+	if (directory.empty()) return blue_noise_mask();
+	std::filesystem::path cache = std::filesystem::path(directory) / ("blue_noise_" + std::to_string(blue_noise_mask::size) + ".mask");
+	return open_cached<blue_noise_mask>(cache.string(), any_mask, []() { return blue_noise_mask(); }, false);
+}
+
+blue_noise_mask const& blue_noise() {
+	static blue_noise_mask const mask = open_cached_blue_noise();
+	return mask;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef LAB3_BLUE_NOISE_H
+#define LAB3_BLUE_NOISE_H
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace lab3 {
+
+// A blue-noise threshold mask made by Ulichney's void-and-cluster method: the
+// cells ranked 0 .. k - 1 are spread as evenly over the torus as k points can
+// be, for every k, so thresholding against it leaves no pattern at any level.
+// Tiling it over the image gives dots close to error diffusion, but every
+// pixel is decided on its own.
+struct blue_noise_mask {
+	static size_t const size = 64;
+
+	// Runs void-and-cluster, the same mask every time.
+	blue_noise_mask();
+
+	// Reads a mask written by save(), checking that it holds every rank once.
+	// On POSIX systems the file must be a regular file of the user that
+	// nobody else can write, and is not followed if it is a symlink.
+	explicit blue_noise_mask(std::string const& filename);
+
+	blue_noise_mask(blue_noise_mask const&) = delete;
+
+	blue_noise_mask& operator=(blue_noise_mask const&) = delete;
+
+	blue_noise_mask(blue_noise_mask&&) = default;
+
+	blue_noise_mask& operator=(blue_noise_mask&&) = default;
+
+	~blue_noise_mask() = default;
+
+	void save(std::string const& filename) const;
+
+	// From 0 to size * size - 1, every rank once.
+	uint16_t rank(size_t i, size_t j) const {
+		return ranks[i * size + j];
+	}
+
+private:
+	std::unique_ptr<uint16_t[]> ranks;
+};
+
+// Reads the mask from filename if it is there, otherwise makes it and saves it
+// there for the next run.
+blue_noise_mask open_blue_noise(std::string const& filename);
+
+// The mask of this process, read once from the cache directory of the user
+// ($XDG_CACHE_HOME/lab3, or ~/.cache/lab3, created private to the user). A
+// cache that is missing or not a valid mask is made again; without a usable
+// cache directory the mask is only kept in memory.
+blue_noise_mask const& blue_noise();
+
+}
+
+#endif
\ No newline at end of file
@@ -1,31 +1,61 @@
 #include <iostream>
 #include <exception>
 #include <string>
+#include <cstring>
 
+#include "../common/batch.h"
+#include "../common/parallel.h"
 #include "pgm_image.h"
 
+using lab3::pgm_image;
+
 int main(int argc, char* argv[]) {
-	if (argc != 7) {
-		std::cerr << "input format: <input file> <output file> <gradient> <dithering> <bit> <gamma>" << std::endl;
+	bool batch_mode = is_batch(argc, argv);
+	batch_options batch;
+	int first_arg = 3;
+	size_t threads = 0;
+	try {
+		if (batch_mode) {
+			batch = parse_batch(argc, argv);
+			first_arg = batch.first_arg;
+			// Files are already processed in parallel.
+			if (batch.threads > 1) threads = 1;
+		} else if (argc > 4 && strcmp(argv[3], "-j") == 0) {
+			threads = get_thread_count(argv[4]);
+			first_arg = 5;
+		}
+	} catch (std::exception const& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	if (argc != first_arg + 4) {
+		std::cerr << "input format: <input file> <output file> [-j <threads>] <gradient> <dithering> <bit> <gamma>" << std::endl;
+		std::cerr << "          or: --batch <manifest or directory> <output directory> [-j <threads>] <gradient> <dithering> <bit> <gamma>" << std::endl;
 		return 1;
 	}
-	if ((argv[3][0] != '0' && argv[3][0] != '1') || argv[3][1] != '\0') {
+	char** args = argv + first_arg - 3;
+	if ((args[3][0] != '0' && args[3][0] != '1') || args[3][1] != '\0') {
 		std::cerr << "gradient should be 0 or 1" << std::endl;
 		return 1;
 	}
 	try {
-		pgm_image image(std::string(argv[1]), argv[3][0]);
-		if (argv[4][1] != '\0' || argv[4][0] < '0' || argv[4][0] > '8') throw std::runtime_error("dithering should be from 0 to 8");
-		if (argv[5][1] != '\0' || argv[5][0] < '1' || argv[5][0] > '8') throw std::runtime_error("num of bits should be from 1 to 8");
+		uint8_t dither_type = lab3::parse_dither(args[4]);
+		if (args[5][1] != '\0' || args[5][0] < '1' || args[5][0] > '8') throw std::runtime_error("num of bits should be from 1 to 8");
 		size_t idx;
 		double gamma;
 		try {
-			gamma = std::stod(argv[6], &idx);
+			gamma = std::stod(args[6], &idx);
 		} catch (...) {
 			throw std::runtime_error("gamma should be valid double number");
 		}
-		if (argv[6][idx] != '\0') throw std::runtime_error("gamma should be valid double number");
-		image.print_to_file(argv[2], argv[4][0], argv[5][0] - '0', gamma);
+		if (args[6][idx] != '\0') throw std::runtime_error("gamma should be valid double number");
+		auto process = [&](std::string const& input, std::string const& output) {
+			pgm_image image(input, args[3][0]);
+			image.set_threads(threads);
+			image.print_to_file(output, dither_type, args[5][0] - '0', gamma);
+		};
+		if (batch_mode) return run_batch(batch, "", process) == 0 ? 0 : 1;
+		process(argv[1], argv[2]);
 	} catch (std::exception const& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
@@ -1,68 +1,92 @@
 #include <string>
-#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <array>
 #include <exception>
 #include <cstring>
 #include <random>
 #include <chrono>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "../common/parallel.h"
+#include "blue_noise.h"
 #include "pgm_image.h"
 
-static uint32_t get_number(const char* s) {
-	char const* cur = s;
-	if (*cur == '\0') throw std::runtime_error("Incorrect format of file");
-	while (*cur != '\0') {
-		if (!std::isdigit(*cur)) throw std::runtime_error("Incorrect format of file");
-		cur++;
-	}
-	uint32_t num = std::stoul(s);
-	if (num == 0) throw std::runtime_error("Incorrect format of file");
-	return num;
-}
+namespace lab3 {
 
 pgm_image::pgm_image(std::string const& filename, char file_type) {
-	std::ifstream input(filename, std::ios_base::binary);
-	if (input.fail()) throw std::runtime_error("Could not open input file");
-	char input_str[128];
-	input.get(input_str, 128, '\n');
-	if (strcmp(input_str, "P5") != 0) throw std::runtime_error("Incorret P5 file");
-	input.ignore();
-	input.get(input_str, 128, ' ');
-	w = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	h = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	depth = get_number(input_str);
+	pnm_file file(filename);
+	pnm_header const& header = file.header();
+	if (header.type != 1) throw std::runtime_error("Incorret P5 file");
+	w = header.w;
+	h = header.h;
+	depth = header.depth;
 	size_t length = static_cast<size_t>(w) * h;
 	try {
-		data = std::unique_ptr<double[]>(new double[length]);
+		data = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
 	} catch (...) {
 		throw std::runtime_error("Could not allocate memory");
 	}
-	input.ignore();
 	if (file_type == '0') {
-		std::unique_ptr<uint8_t[]> buffer;
-		try {
-			buffer = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
-		} catch (...) {
-			throw std::runtime_error("Could not allocate memory");
-		}
-		input.read(reinterpret_cast<char*>(buffer.get()), length);
-		if (input.fail()) throw std::runtime_error("Incorrect format of file");
-		input.ignore();
-		if (!input.eof()) throw std::runtime_error("Incorrect foramt of file");
-		for (size_t i = 0; i < length; i++) data[i] = static_cast<double>(buffer[i]);
+		memcpy(data.get(), file.pixels(), length);
 	} else {
-		double* ptr = data.get();
+		// The gradient is made of 8-bit levels like any input file.
+		uint8_t* ptr = data.get();
 		for (size_t i = 0; i < h; i++) {
 			double cur_color = 0;
 			double diff = static_cast<double>(255) / (w - 1);
-			for (size_t j = 0; j < w; j++, cur_color += diff) *ptr++ = cur_color;
+			for (size_t j = 0; j < w; j++, cur_color += diff) *ptr++ = round(cur_color);
 		}
 	}
 }
 
+pgm_image::pgm_image(pnm_header const& header, uint8_t const* pixels) : w(header.w), h(header.h), depth(header.depth) {
+	if (header.type != 1) throw std::runtime_error("Incorret P5 file");
+	size_t length = static_cast<size_t>(w) * h;
+	try {
+		data = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	memcpy(data.get(), pixels, length);
+}
+
+void pgm_image::set_threads(size_t count) {
+	threads = count;
+}
+
+pnm_header pgm_image::header() const {
+	pnm_header header;
+	header.type = 1;
+	header.w = w;
+	header.h = h;
+	header.depth = depth;
+	return header;
+}
+
+std::unique_ptr<uint8_t[]> pgm_image::get_pixels() const {
+	size_t length = static_cast<size_t>(w) * h;
+	std::unique_ptr<uint8_t[]> pixels;
+	try {
+		pixels = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	memcpy(pixels.get(), data.get(), length);
+	return pixels;
+}
+
 static double get_round(uint8_t i_bit, uint8_t num_variants) {
 	return static_cast<double>(i_bit) * 255 / num_variants;
 }
@@ -75,61 +99,171 @@ static double get_real(double y, double gamma) {
 	return pow(y, gamma);
 }
 
+// Everything the dithers need to know about the input values and the output
+// levels for one num_bits and gamma, so that the pixel loops never call pow.
+// Input values are 8-bit, level i is i * 255 / num_variants.
+struct quantizer {
+	uint8_t num_variants;
+	// The level right below each input value.
+	uint8_t lower[256];
+	// Linear light of each input value and of each level.
+	double linear[256];
+	double level_linear[256];
+	// The value each level is written as.
+	uint8_t level_value[256];
+
+	quantizer(uint8_t num_bits, double gamma) : num_variants((1ull << num_bits) - 1) {
+		double const div = static_cast<double>(255) / num_variants;
+		for (size_t i = 0; i < 256; i++) {
+			lower[i] = floor(i / div);
+			linear[i] = get_real(i, gamma);
+		}
+		for (size_t i = 0; i <= num_variants; i++) {
+			double level = get_round(i, num_variants);
+			level_linear[i] = get_real(level, gamma);
+			level_value[i] = round(level);
+		}
+	}
+};
+
+
 void pgm_image::no_dither(uint8_t num_bits, double gamma) {
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
+	quantizer const q(num_bits, gamma);
 	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) {
-		double pixel = data[i] / div;
-		uint8_t left_bits = floor(pixel);
-		if (left_bits == num_variants) {
+		uint8_t value = data[i];
+		uint8_t left_bits = q.lower[value];
+		if (left_bits == q.num_variants) {
 			data[i] = 255;
 			continue;
 		}
 		uint8_t right_bits = left_bits + 1;
-		double left_round = get_round(left_bits, num_variants);
-		double right_round = get_round(right_bits, num_variants);
-		double left_real = get_real(left_round, gamma);	
-		double right_real = get_real(right_round, gamma);
-		double cur_real = get_real(data[i], gamma);
-		data[i] = (std::abs(cur_real - left_real) <= std::abs(cur_real - right_real)) ? round(left_round) : round(right_round);
+		double left_real = q.level_linear[left_bits];
+		double right_real = q.level_linear[right_bits];
+		double cur_real = q.linear[value];
+		data[i] = (std::abs(cur_real - left_real) <= std::abs(cur_real - right_real)) ? q.level_value[left_bits] : q.level_value[right_bits];
 	}
 }
 
-void pgm_image::ordered_dither(uint8_t num_bits, double gamma) {
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
-	double matrix[8][8] = { 0, 32, 8, 40, 2, 34, 10, 42,
-	                        48, 16, 56, 24, 50, 18, 58, 26,
-		                    12, 44, 4, 36, 14, 46, 6, 38,
-                            60, 28, 52, 20, 62, 30, 54, 22,
-                            3, 35, 11, 43, 1, 33, 9, 41,
-	                        51, 19, 59, 27, 49, 17, 57, 25,
-	                        15, 47, 7, 39, 13, 45, 5, 37,
-	                        63, 31, 55, 23, 61, 29, 53, 21 };
-	for (size_t i = 0; i < 8; i++) {
-		for (size_t j = 0; j < 8; j++) {
-			matrix[i][j] = (matrix[i][j] + 1) / 65;
+// Bayer's recursive ordered dither matrix, entries 0 .. N * N - 1: each
+// doubling puts 4m, 4m + 2, 4m + 3 and 4m + 1 in the four quadrants.
+template<size_t N>
+constexpr std::array<std::array<uint32_t, N>, N> bayer_matrix() {
+	static_assert(N != 0 && (N & (N - 1)) == 0, "Bayer matrices are a power of two wide");
+	std::array<std::array<uint32_t, N>, N> matrix{};
+	for (size_t size = 1; size < N; size *= 2) {
+		for (size_t i = 0; i < size; i++) {
+			for (size_t j = 0; j < size; j++) {
+				uint32_t m = 4 * matrix[i][j];
+				matrix[i][j] = m;
+				matrix[i][j + size] = m + 2;
+				matrix[i + size][j] = m + 3;
+				matrix[i + size][j + size] = m + 1;
+			}
+		}
+	}
+	return matrix;
+}
+
+static_assert(bayer_matrix<8>()[1][0] == 48 && bayer_matrix<8>()[7][7] == 21, "Not the usual 8x8 Bayer matrix");
+
+// Levels up to this many are thresholded with vector compares, above it a
+// table lookup per pixel is faster.
+static size_t const max_vector_levels = 15;
+
+#if defined(__AVX2__)
+static size_t const vector_width = 32;
+#else
+static size_t const vector_width = 16;
+#endif
+
+// With the threshold of every cell fixed, the output of a pixel only depends
+// on its value and grows with it: it is level k from the first value whose
+// linear light reaches past the threshold between levels k - 1 and k.
+template<size_t N>
+void pgm_image::threshold_dither(double const (&thresholds)[N][N], uint8_t num_bits, double gamma) {
+	quantizer const q(num_bits, gamma);
+	size_t const num_variants = q.num_variants;
+	std::unique_ptr<uint8_t[]> table;
+	// For every row of the map and level k, the first value that reaches
+	// level k in each column, repeated past N so that a vector can be
+	// loaded from any column.
+	size_t const row_stride = N + vector_width;
+	std::unique_ptr<uint8_t[]> firsts;
+	try {
+		table = std::unique_ptr<uint8_t[]>(new uint8_t[N * N * 256]);
+		firsts = std::unique_ptr<uint8_t[]>(new uint8_t[N * num_variants * row_stride]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
+	}
+	for (size_t r = 0; r < N; r++) {
+		for (size_t c = 0; c < N; c++) {
+			uint8_t* out = table.get() + (r * N + c) * 256;
+			size_t level = 0;
+			for (size_t value = 0; value < 256; value++) {
+				uint8_t left_bits = q.lower[value];
+				size_t cur_level = num_variants;
+				if (left_bits != num_variants) {
+					double left_real = q.level_linear[left_bits];
+					double diff = q.level_linear[left_bits + 1] - left_real;
+					cur_level = (q.linear[value] < left_real + diff * thresholds[r][c]) ? left_bits : left_bits + 1;
+				}
+				out[value] = q.level_value[cur_level];
+				for (; level < cur_level; level++) {
+					for (size_t x = c; x < row_stride; x += N) firsts[(r * num_variants + level) * row_stride + x] = value;
+				}
+			}
 		}
 	}
 	for (size_t i = 0; i < h; i++) {
-		for (size_t j = 0; j < w; j++) {
-			size_t k = i * w + j;
-			double pixel = data[k] / div;
-			uint8_t left_bits = floor(pixel);
-			if (left_bits == num_variants) {
-				data[k] = 255;
-				continue;
+		size_t r = i % N;
+		uint8_t* pixels = data.get() + i * w;
+		size_t j = 0;
+#ifdef __SSE2__
+		if (num_variants <= max_vector_levels) {
+			// Each level reached adds the step up to it.
+			uint8_t const* row_firsts = firsts.get() + r * num_variants * row_stride;
+#ifdef __AVX2__
+			for (; j + 32 <= w; j += 32) {
+				__m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pixels + j));
+				__m256i out = _mm256_setzero_si256();
+				for (size_t k = 0; k < num_variants; k++) {
+					__m256i first = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(row_firsts + k * row_stride + j % N));
+					__m256i reached = _mm256_cmpeq_epi8(_mm256_max_epu8(p, first), p);
+					__m256i step = _mm256_set1_epi8(static_cast<char>(q.level_value[k + 1] - q.level_value[k]));
+					out = _mm256_add_epi8(out, _mm256_and_si256(reached, step));
+				}
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + j), out);
+			}
+#endif
+			for (; j + 16 <= w; j += 16) {
+				__m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pixels + j));
+				__m128i out = _mm_setzero_si128();
+				for (size_t k = 0; k < num_variants; k++) {
+					__m128i first = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row_firsts + k * row_stride + j % N));
+					__m128i reached = _mm_cmpeq_epi8(_mm_max_epu8(p, first), p);
+					__m128i step = _mm_set1_epi8(static_cast<char>(q.level_value[k + 1] - q.level_value[k]));
+					out = _mm_add_epi8(out, _mm_and_si128(reached, step));
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + j), out);
 			}
-			uint8_t right_bits = left_bits + 1;
-			double left_round = get_round(left_bits, num_variants);
-			double right_round = get_round(right_bits, num_variants);
-			double left_real = get_real(left_round, gamma);
-			double right_real = get_real(right_round, gamma);
-			double cur_real = get_real(data[k], gamma);
-			double diff = right_real - left_real;
-			data[k] = (cur_real < left_real + diff * matrix[j % 8][i % 8]) ? round(left_round) : round(right_round);
+		}
+#endif
+		uint8_t const* row_table = table.get() + r * N * 256;
+		for (; j < w; j++) pixels[j] = row_table[(j % N) * 256 + pixels[j]];
+	}
+}
+
+void pgm_image::ordered_dither(uint8_t num_bits, double gamma) {
+	constexpr size_t n = 8;
+	constexpr std::array<std::array<uint32_t, n>, n> bayer = bayer_matrix<n>();
+	// The matrix is laid transposed over the image.
+	double thresholds[n][n];
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			thresholds[i][j] = (bayer[j][i] + 1.0) / (n * n + 1);
 		}
 	}
+	threshold_dither(thresholds, num_bits, gamma);
 }
 
 void pgm_image::random_dither(uint8_t num_bits, double gamma) {
@@ -138,300 +272,290 @@ void pgm_image::random_dither(uint8_t num_bits, double gamma) {
 	std::seed_seq seed{ static_cast<uint32_t>(time_seed & 0xFFFFFFFF), static_cast<uint32_t>(time_seed >> 32) };
 	rnd.seed(seed);
 	std::uniform_real_distribution<double> unif(0, 1);
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
+	quantizer const q(num_bits, gamma);
 	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) {
-		double pixel = data[i] / div;
-		uint8_t left_bits = floor(pixel);
-		if (left_bits == num_variants) {
+		uint8_t value = data[i];
+		uint8_t left_bits = q.lower[value];
+		if (left_bits == q.num_variants) {
 			data[i] = 255;
 			continue;
 		}
 		uint8_t right_bits = left_bits + 1;
-		double left_round = get_round(left_bits, num_variants);
-		double right_round = get_round(right_bits, num_variants);
-		double left_real = get_real(left_round, gamma);
-		double right_real = get_real(right_round, gamma);
-		double cur_real = get_real(data[i], gamma);
+		double left_real = q.level_linear[left_bits];
+		double right_real = q.level_linear[right_bits];
+		double cur_real = q.linear[value];
 		double diff = right_real - left_real;
 		cur_real += diff * unif(rnd);
-		data[i] = (cur_real >= right_real) ? round(right_round) : round(left_round);
+		data[i] = (cur_real >= right_real) ? q.level_value[right_bits] : q.level_value[left_bits];
 	}
 }
 
-void pgm_image::floyd_steinberg_dither(uint8_t num_bits, double gamma) {
-	std::unique_ptr<double[]> error;
-	try {
-		error = std::unique_ptr<double[]>(new double[static_cast<size_t>(w) * h]);
-	} catch (...) {
-		throw std::runtime_error("Could not allocate memory");
-	}
-	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) error[i] = 0;
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
-	for (size_t i = 0; i < h; i++) {
-		for (size_t j = 0; j < w; j++) {
-			size_t k = i * w + j;
-			double pixel = data[k] / div;
-			uint8_t left_bits = floor(pixel);
-			if (left_bits == num_variants) {
-				data[k] = 255;
-				continue;
-			}
-			uint8_t right_bits = left_bits + 1;
-			double left_round = get_round(left_bits, num_variants);
-			double right_round = get_round(right_bits, num_variants);
-			double left_real = get_real(left_round, gamma);
-			double right_real = get_real(right_round, gamma);
-			double cur_real = get_real(data[k], gamma);
-			double diff = right_real - left_real;
-			cur_real += diff * error[k];
-			double quant_error;
-			if (cur_real < right_real) {
-				data[k] = round(left_round);
-				quant_error = (cur_real - left_real) / diff;
-			} else {
-				data[k] = round(right_round);
-				quant_error = (cur_real - right_real) / diff;
-			}
-			if (j + 1 < w) error[i * w + (j + 1)] += quant_error * 7 / 16;
-			if (j > 0 && i + 1 < h) error[(i + 1) * w + (j - 1)] += quant_error * 3 / 16;
-			if (i + 1 < h) error[(i + 1) * w + j] += quant_error * 5 / 16;
-			if (i + 1 < h && j + 1 < w) error[(i + 1) * w + (j + 1)] += quant_error / 16;
+// One tap of an error diffusion kernel: weight / divisor of the error goes to
+// the pixel dy rows below and dx columns to the right.
+struct diffusion_tap {
+	int dy, dx;
+	int weight;
+};
+
+// The kernels only reach forward: right on the same row or onto the rows below.
+struct floyd_steinberg {
+	static constexpr int divisor = 16;
+	static constexpr diffusion_tap taps[] = {{0, 1, 7}, {1, -1, 3}, {1, 0, 5}, {1, 1, 1}};
+};
+
+struct jarvis_judice_ninke {
+	static constexpr int divisor = 48;
+	static constexpr diffusion_tap taps[] = {{0, 1, 7}, {0, 2, 5},
+		{1, -2, 3}, {1, -1, 5}, {1, 0, 7}, {1, 1, 5}, {1, 2, 3}, {2, -2, 1}, {2, -1, 3}, {2, 0, 5}, {2, 1, 3}, {2, 2, 1}};
+};
+
+struct sierra {
+	static constexpr int divisor = 32;
+	static constexpr diffusion_tap taps[] = {{0, 1, 5}, {0, 2, 3},
+		{1, -2, 2}, {1, -1, 4}, {1, 0, 5}, {1, 1, 4}, {1, 2, 2}, {2, -1, 2}, {2, 0, 3}, {2, 1, 2}};
+};
+
+struct atkinson {
+	static constexpr int divisor = 8;
+	static constexpr diffusion_tap taps[] = {{0, 1, 1}, {0, 2, 1}, {1, -1, 1}, {1, 0, 1}, {1, 1, 1}, {2, 0, 1}};
+};
+
+struct stucki {
+	static constexpr int divisor = 42;
+	static constexpr diffusion_tap taps[] = {{0, 1, 8}, {0, 2, 4},
+		{1, -2, 2}, {1, -1, 4}, {1, 0, 8}, {1, 1, 4}, {1, 2, 2}, {2, -2, 1}, {2, -1, 2}, {2, 0, 4}, {2, 1, 2}, {2, 2, 1}};
+};
+
+struct burkes {
+	static constexpr int divisor = 32;
+	static constexpr diffusion_tap taps[] = {{0, 1, 8}, {0, 2, 4}, {1, -2, 2}, {1, -1, 4}, {1, 0, 8}, {1, 1, 4}, {1, 2, 2}};
+};
+
+struct sierra_lite {
+	static constexpr int divisor = 4;
+	static constexpr diffusion_tap taps[] = {{0, 1, 2}, {1, -1, 1}, {1, 0, 1}};
+};
+
+template<typename Kernel>
+constexpr size_t kernel_rows() {
+	int rows = 0;
+	for (diffusion_tap const& tap : Kernel::taps) rows = std::max(rows, tap.dy);
+	return rows + 1;
+}
+
+template<typename Kernel>
+constexpr size_t kernel_reach() {
+	int reach = 0;
+	for (diffusion_tap const& tap : Kernel::taps) reach = std::max(reach, tap.dx < 0 ? -tap.dx : tap.dx);
+	return reach;
+}
+
+// The error still to be spread over the coming rows. Only the rows the
+// kernel reaches from the current one are kept, in a ring, so the error
+// takes a few rows of memory rather than a whole plane. Each row has pad
+// columns on both sides that soak up what falls off the image, so that
+// the kernel never has to check for the borders.
+struct error_rows {
+	error_rows(size_t w, size_t count, size_t pad) : stride(w + 2 * pad), count(count), pad(pad) {
+		try {
+			buffer = std::unique_ptr<float[]>(new float[stride * count]);
+		} catch (...) {
+			throw std::runtime_error("Could not allocate memory");
 		}
+		std::fill(buffer.get(), buffer.get() + stride * count, 0.0f);
 	}
-}
 
-void pgm_image::jarvis_judice_ninke_dither(uint8_t num_bits, double gamma) {
-	std::unique_ptr<double[]> error;
-	try {
-		error = std::unique_ptr<double[]>(new double[static_cast<size_t>(w) * h]);
-	} catch (...) {
-		throw std::runtime_error("Could not allocate memory");
+	float* row(size_t i) {
+		return buffer.get() + (i % count) * stride + pad;
 	}
-	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) error[i] = 0;
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
-	for (size_t i = 0; i < h; i++) {
-		for (size_t j = 0; j < w; j++) {
-			size_t k = i * w + j;
-			double pixel = data[k] / div;
-			uint8_t left_bits = floor(pixel);
-			if (left_bits == num_variants) {
-				data[k] = 255;
-				continue;
-			}
-			uint8_t right_bits = left_bits + 1;
-			double left_round = get_round(left_bits, num_variants);
-			double right_round = get_round(right_bits, num_variants);
-			double left_real = get_real(left_round, gamma);
-			double right_real = get_real(right_round, gamma);
-			double cur_real = get_real(data[k], gamma);
-			double diff = right_real - left_real;
-			cur_real += diff * error[k];
-			double quant_error;
-			if (cur_real < right_real) {
-				data[k] = round(left_round);
-				quant_error = (cur_real - left_real) / diff;
-			} else {
-				data[k] = round(right_round);
-				quant_error = (cur_real - right_real) / diff;
-			}
-			if (j + 1 < w) error[i * w + (j + 1)] += quant_error * 7 / 48;
-			if (j + 2 < w) error[i * w + (j + 2)] += quant_error * 5 / 48;
-			if (i + 1 < h) {
-				if (j - 2 >= 0) error[(i + 1) * w + (j - 2)] += quant_error * 3 / 48;
-				if (j - 1 >= 0) error[(i + 1) * w + (j - 1)] += quant_error * 5 / 48;
-				error[(i + 1) * w + j] += quant_error * 7 / 48;
-				if (j + 1 < w) error[(i + 1) * w + (j + 1)] += quant_error * 5 / 48;
-				if (j + 2 < w) error[(i + 1) * w + (j + 2)] += quant_error * 3 / 48;
-			}
-			if (i + 2 < h) {
-				if (j - 2 >= 0) error[(i + 2) * w + (j - 2)] += quant_error * 1 / 48;
-				if (j - 1 >= 0) error[(i + 2) * w + (j - 1)] += quant_error * 3 / 48;
-				error[(i + 2) * w + j] += quant_error * 5 / 48;
-				if (j + 1 < w) error[(i + 2) * w + (j + 1)] += quant_error * 3 / 48;
-				if (j + 2 < w) error[(i + 2) * w + (j + 2)] += quant_error * 1 / 48;
-			}
-		}
+
+	// Row i is done, its slot is reused for row i + count.
+	void finish(size_t i) {
+		std::fill(row(i) - pad, row(i) - pad + stride, 0.0f);
 	}
-}
 
-void pgm_image::sierra_dither(uint8_t num_bits, double gamma) {
-	std::unique_ptr<double[]> error;
-	try {
-		error = std::unique_ptr<double[]>(new double[static_cast<size_t>(w) * h]);
-	} catch (...) {
-		throw std::runtime_error("Could not allocate memory");
+private:
+	size_t stride, count, pad;
+	std::unique_ptr<float[]> buffer;
+};
+
+// Quantizes a pixel carrying error, in units of the gap between the two
+// levels around it, and returns the error left for its neighbours.
+static inline double quantize(quantizer const& q, uint8_t& pixel, float error) {
+	uint8_t left_bits = q.lower[pixel];
+	if (left_bits == q.num_variants) {
+		pixel = 255;
+		return 0;
 	}
-	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) error[i] = 0;
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
-	for (size_t i = 0; i < h; i++) {
-		for (size_t j = 0; j < w; j++) {
-			size_t k = i * w + j;
-			double pixel = data[k] / div;
-			uint8_t left_bits = floor(pixel);
-			if (left_bits == num_variants) {
-				data[k] = 255;
-				continue;
-			}
-			uint8_t right_bits = left_bits + 1;
-			double left_round = get_round(left_bits, num_variants);
-			double right_round = get_round(right_bits, num_variants);
-			double left_real = get_real(left_round, gamma);
-			double right_real = get_real(right_round, gamma);
-			double cur_real = get_real(data[k], gamma);
-			double diff = right_real - left_real;
-			cur_real += diff * error[k];
-			double quant_error;
-			if (cur_real < right_real) {
-				data[k] = round(left_round);
-				quant_error = (cur_real - left_real) / diff;
-			} else {
-				data[k] = round(right_round);
-				quant_error = (cur_real - right_real) / diff;
-			}
-			if (j + 1 < w) error[i * w + (j + 1)] += quant_error * 5 / 32;
-			if (j + 2 < w) error[i * w + (j + 2)] += quant_error * 3 / 32;
-			if (i + 1 < h) {
-				if (j - 2 >= 0) error[(i + 1) * w + (j - 2)] += quant_error * 2 / 32;
-				if (j - 1 >= 0) error[(i + 1) * w + (j - 1)] += quant_error * 4 / 32;
-				error[(i + 1) * w + j] += quant_error * 5 / 32;
-				if (j + 1 < w) error[(i + 1) * w + (j + 1)] += quant_error * 4 / 32;
-				if (j + 2 < w) error[(i + 1) * w + (j + 2)] += quant_error * 2 / 32;
-			}
-			if (i + 2 < h) {
-				if (j - 1 >= 0) error[(i + 2) * w + (j - 1)] += quant_error * 2 / 32;
-				error[(i + 2) * w + j] += quant_error * 3 / 32;
-				if (j + 1 < w) error[(i + 2) * w + (j + 1)] += quant_error * 2 / 32;
-			}
-		}
+	uint8_t right_bits = left_bits + 1;
+	double left_real = q.level_linear[left_bits];
+	double right_real = q.level_linear[right_bits];
+	double cur_real = q.linear[pixel];
+	double diff = right_real - left_real;
+	cur_real += diff * error;
+	if (cur_real < right_real) {
+		pixel = q.level_value[left_bits];
+		return (cur_real - left_real) / diff;
+	}
+	pixel = q.level_value[right_bits];
+	return (cur_real - right_real) / diff;
+}
+
+// Unrolled over the taps of the kernel, rows[dy] is the error row dy below.
+template<typename Kernel, size_t... I>
+static inline void spread(float* const* rows, size_t j, double quant_error, std::index_sequence<I...>) {
+	((rows[Kernel::taps[I].dy][static_cast<ptrdiff_t>(j) + Kernel::taps[I].dx] += quant_error * Kernel::taps[I].weight / Kernel::divisor), ...);
+}
+
+template<typename Kernel>
+static void diffuse_columns(quantizer const& q, uint8_t* pixels, float* const* rows, size_t begin, size_t end) {
+	for (size_t j = begin; j < end; j++) {
+		double quant_error = quantize(q, pixels[j], rows[0][j]);
+		spread<Kernel>(rows, j, quant_error, std::make_index_sequence<std::size(Kernel::taps)>());
 	}
 }
 
-void pgm_image::atkinson_dither(uint8_t num_bits, double gamma) {
-	std::unique_ptr<double[]> error;
+// Images smaller than this are not worth starting threads for.
+static size_t const min_wavefront_pixels = 1 << 18;
+
+// Rows publish how far they got every this many columns.
+static size_t const wavefront_chunk = 64;
+
+template<typename Kernel>
+void pgm_image::error_diffusion_dither(uint8_t num_bits, double gamma) {
+	constexpr size_t num_rows = kernel_rows<Kernel>();
+	constexpr size_t reach = kernel_reach<Kernel>();
+	quantizer const q(num_bits, gamma);
+	size_t workers = std::min<size_t>(threads == 0 ? default_threads() : threads, h);
+	if (workers <= 1 || static_cast<size_t>(w) * h < min_wavefront_pixels) {
+		error_rows error(w, num_rows, reach);
+		float* rows[num_rows];
+		for (size_t i = 0; i < h; i++) {
+			for (size_t r = 0; r < num_rows; r++) rows[r] = error.row(i + r);
+			diffuse_columns<Kernel>(q, data.get() + i * w, rows, 0, w);
+			error.finish(i);
+		}
+		return;
+	}
+	// Row i goes to worker i % workers and trails row i - 1 by lag columns:
+	// by then every error it reads is complete, and every cell it adds to
+	// has already received what the rows above add to it, so the sums are
+	// made in the same order as in a single thread and the result is the
+	// same. The ring holds the rows of all the workers plus the rows below.
+	size_t const lag = 2 * reach;
+	error_rows error(w, workers + num_rows - 1, reach);
+	std::unique_ptr<std::atomic<size_t>[]> done;
 	try {
-		error = std::unique_ptr<double[]>(new double[static_cast<size_t>(w) * h]);
+		done = std::unique_ptr<std::atomic<size_t>[]>(new std::atomic<size_t>[h]);
 	} catch (...) {
 		throw std::runtime_error("Could not allocate memory");
 	}
-	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) error[i] = 0;
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
-	for (size_t i = 0; i < h; i++) {
-		for (size_t j = 0; j < w; j++) {
-			size_t k = i * w + j;
-			double pixel = data[k] / div;
-			uint8_t left_bits = floor(pixel);
-			if (left_bits == num_variants) {
-				data[k] = 255;
-				continue;
-			}
-			uint8_t right_bits = left_bits + 1;
-			double left_round = get_round(left_bits, num_variants);
-			double right_round = get_round(right_bits, num_variants);
-			double left_real = get_real(left_round, gamma);
-			double right_real = get_real(right_round, gamma);
-			double cur_real = get_real(data[k], gamma);
-			double diff = right_real - left_real;
-			cur_real += diff * error[k];
-			double quant_error;
-			if (cur_real < right_real) {
-				data[k] = round(left_round);
-				quant_error = (cur_real - left_real) / diff;
-			} else {
-				data[k] = round(right_round);
-				quant_error = (cur_real - right_real) / diff;
-			}
-			if (j + 1 < w) error[i * w + (j + 1)] += quant_error / 8;
-			if (j + 2 < w) error[i * w + (j + 2)] += quant_error / 8;
-			if (i + 1 < h) {
-				if (j - 1 >= 0) error[(i + 1) * w + (j - 1)] += quant_error / 8;
-				error[(i + 1) * w + j] += quant_error / 8;
-				if (j + 1 < w) error[(i + 1) * w + (j + 1)] += quant_error / 8;
-			}
-			if (i + 2 < h) {
-				error[(i + 2) * w + j] += quant_error / 8;
+	for (size_t i = 0; i < h; i++) done[i].store(0, std::memory_order_relaxed);
+	auto worker = [&](size_t first) {
+		float* rows[num_rows];
+		for (size_t i = first; i < h; i += workers) {
+			for (size_t r = 0; r < num_rows; r++) rows[r] = error.row(i + r);
+			uint8_t* pixels = data.get() + i * w;
+			for (size_t begin = 0; begin < w; begin += wavefront_chunk) {
+				size_t end = std::min<size_t>(begin + wavefront_chunk, w);
+				if (i > 0) {
+					size_t needed = std::min<size_t>(end + lag, w);
+					while (done[i - 1].load(std::memory_order_acquire) < needed) std::this_thread::yield();
+				}
+				diffuse_columns<Kernel>(q, pixels, rows, begin, end);
+				done[i].store(end, std::memory_order_release);
 			}
+			error.finish(i);
 		}
-	}
+	};
+	std::vector<std::thread> pool;
+	for (size_t t = 1; t < workers; t++) pool.emplace_back(worker, t);
+	worker(0);
+	for (std::thread& t : pool) t.join();
 }
 
 void pgm_image::halftone_dither(uint8_t num_bits, double gamma) {
-	uint8_t const num_variants = (1ull << num_bits) - 1;
-	double const div = static_cast<double>(255) / num_variants;
-	double matrix[4][4] = { 7, 13, 11, 4,
-							12, 16, 14, 8,
-							10, 15, 6, 2,
-							5, 9, 3, 1 };
+	uint8_t const matrix[4][4] = { 7, 13, 11, 4,
+	                               12, 16, 14, 8,
+	                               10, 15, 6, 2,
+	                               5, 9, 3, 1 };
+	double thresholds[4][4];
 	for (size_t i = 0; i < 4; i++) {
 		for (size_t j = 0; j < 4; j++) {
-			matrix[i][j] /= 17;
+			thresholds[i][j] = matrix[i][j] / 17.0;
 		}
 	}
-	for (size_t i = 0; i < h; i++) {
-		for (size_t j = 0; j < w; j++) {
-			size_t k = i * w + j;
-			double pixel = data[k] / div;
-			uint8_t left_bits = floor(pixel);
-			if (left_bits == num_variants) {
-				data[k] = 255;
-				continue;
-			}
-			uint8_t right_bits = left_bits + 1;
-			double left_round = get_round(left_bits, num_variants);
-			double right_round = get_round(right_bits, num_variants);
-			double left_real = get_real(left_round, gamma);
-			double right_real = get_real(right_round, gamma);
-			double cur_real = get_real(data[k], gamma);
-			double diff = right_real - left_real;
-			data[k] = (cur_real < left_real + diff * matrix[i % 4][j % 4]) ? round(left_round) : round(right_round);
+	threshold_dither(thresholds, num_bits, gamma);
+}
+
+void pgm_image::blue_noise_dither(uint8_t num_bits, double gamma) {
+	constexpr size_t n = blue_noise_mask::size;
+	blue_noise_mask const& mask = blue_noise();
+	double thresholds[n][n];
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			thresholds[i][j] = (mask.rank(i, j) + 1.0) / (n * n + 1);
 		}
 	}
+	threshold_dither(thresholds, num_bits, gamma);
+}
+
+uint8_t parse_dither(char const* arg) {
+	size_t type = 0;
+	size_t i = 0;
+	for (; i < 2 && arg[i] >= '0' && arg[i] <= '9'; i++) type = 10 * type + (arg[i] - '0');
+	if (i == 0 || arg[i] != '\0' || (i == 2 && arg[0] == '0') || type >= num_dither_types) {
+		throw std::runtime_error("dithering should be from 0 to " + std::to_string(num_dither_types - 1));
+	}
+	return type;
 }
 
-void pgm_image::print_to_file(std::string const& filename, char dither_type, uint8_t num_bits, double gamma) {
+void pgm_image::dither(uint8_t dither_type, uint8_t num_bits, double gamma) {
 	switch (dither_type) {
-	case '0':
+	case 0:
 		no_dither(num_bits, gamma);
 		break;
-	case '1':
+	case 1:
 		ordered_dither(num_bits, gamma);
 		break;
-	case '2':
+	case 2:
 		random_dither(num_bits, gamma);
 		break;
-	case '3':
-		floyd_steinberg_dither(num_bits, gamma);
+	case 3:
+		error_diffusion_dither<floyd_steinberg>(num_bits, gamma);
 		break;
-	case '4':
-		jarvis_judice_ninke_dither(num_bits, gamma);
+	case 4:
+		error_diffusion_dither<jarvis_judice_ninke>(num_bits, gamma);
 		break;
-	case '5':
-		sierra_dither(num_bits, gamma);
+	case 5:
+		error_diffusion_dither<sierra>(num_bits, gamma);
 		break;
-	case '6':
-		atkinson_dither(num_bits, gamma);
+	case 6:
+		error_diffusion_dither<atkinson>(num_bits, gamma);
 		break;
-	case '7':
+	case 7:
 		halftone_dither(num_bits, gamma);
 		break;
+	case 8:
+		error_diffusion_dither<stucki>(num_bits, gamma);
+		break;
+	case 9:
+		error_diffusion_dither<burkes>(num_bits, gamma);
+		break;
+	case 10:
+		error_diffusion_dither<sierra_lite>(num_bits, gamma);
+		break;
+	case 11:
+		blue_noise_dither(num_bits, gamma);
+		break;
 	default:
 		throw std::runtime_error("Incorrect type of dithering");
 	}
-	std::ofstream output(filename, std::ios_base::binary);
-	output << "P5\n";
-	output << w << " " << h << "\n";
-	output << depth << "\n";
-	for (size_t i = 0; i < static_cast<size_t>(w) * h; i++) {
-		uint8_t num = data[i];
-		output.write(reinterpret_cast<char*>(&num), 1);
-	}
-	if (output.fail()) {
-		output.close();
-		std::remove(filename.c_str());
-		throw std::runtime_error("Could not write to the file");
-	}
+}
+
+void pgm_image::print_to_file(std::string const& filename, uint8_t dither_type, uint8_t num_bits, double gamma) {
+	dither(dither_type, num_bits, gamma);
+	write_pnm(filename, header(), data.get());
+}
+
 }
\ No newline at end of file
@@ -1,24 +1,49 @@
-#ifndef PGM_IMAGE_H
-#define PGM_IMAGE_H
+#ifndef LAB3_PGM_IMAGE_H
+#define LAB3_PGM_IMAGE_H
 
 #include <memory>
 #include <cstdint>
+#include <string>
+
+#include "../common/pnm_io.h"
+
+namespace lab3 {
+
+// Dithering types: 0 none, 1 ordered (8x8 Bayer), 2 random, 3 Floyd-Steinberg,
+// 4 Jarvis-Judice-Ninke, 5 Sierra, 6 Atkinson, 7 halftone (4x4), 8 Stucki,
+// 9 Burkes, 10 Sierra Lite, 11 blue noise (64x64 void-and-cluster mask).
+uint8_t const num_dither_types = 12;
+
+uint8_t parse_dither(char const* arg);
 
 struct pgm_image {
 	pgm_image(std::string const& filename, char file_type);
 
+	pgm_image(pnm_header const& header, uint8_t const* pixels);
+
 	pgm_image(pgm_image const&) = delete;
 
 	pgm_image& operator=(pgm_image const&) = delete;
 
 	~pgm_image() = default;
 
-	void print_to_file(std::string const& filename, char dither_type, uint8_t num_bits, double gamma);
+	void print_to_file(std::string const& filename, uint8_t dither_type, uint8_t num_bits, double gamma);
+
+	void dither(uint8_t dither_type, uint8_t num_bits, double gamma);
+
+	// Error diffusion runs rows on this many threads in a wavefront, 0 means
+	// one per hardware thread. The result does not depend on it.
+	void set_threads(size_t count);
+
+	pnm_header header() const;
+
+	std::unique_ptr<uint8_t[]> get_pixels() const;
 
 private:
-	std::unique_ptr<double[]> data;
+	std::unique_ptr<uint8_t[]> data;
 	uint32_t w, h;
 	uint16_t depth;
+	size_t threads = 0;
 
 	void no_dither(uint8_t num_bits, double gamma);
 
@@ -26,15 +51,20 @@ private:
 
 	void random_dither(uint8_t num_bits, double gamma);
 
-	void floyd_steinberg_dither(uint8_t num_bits, double gamma);
-
-	void jarvis_judice_ninke_dither(uint8_t num_bits, double gamma);
+	// Kernel is one of the diffusion kernels of pgm_image.cpp.
+	template<typename Kernel>
+	void error_diffusion_dither(uint8_t num_bits, double gamma);
 
-	void sierra_dither(uint8_t num_bits, double gamma);
+	void halftone_dither(uint8_t num_bits, double gamma);
 
-	void atkinson_dither(uint8_t num_bits, double gamma);
+	void blue_noise_dither(uint8_t num_bits, double gamma);
 
-	void halftone_dither(uint8_t num_bits, double gamma);
+	// Compares every pixel with the threshold map tiled over the image,
+	// thresholds[i % N][j % N] between 0 and 1 for row i, column j.
+	template<size_t N>
+	void threshold_dither(double const (&thresholds)[N][N], uint8_t num_bits, double gamma);
 };
 
+}
+
 #endif
\ No newline at end of file
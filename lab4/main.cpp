@@ -2,8 +2,11 @@
 #include <string>
 #include <exception>
 
+#include "../common/batch.h"
 #include "pnm_image.h"
 
+using lab4::pnm_image;
+
 template<typename T>
 T get_valid_number(char const* arg, T(*to_number)(char const*, size_t*), std::string const& var_name, std::string const& type_name) {
 	try {
@@ -26,8 +29,23 @@ double get_double(char const* arg, size_t* index) {
 }
 
 int main(int argc, char* argv[]) {
-	std::string const input_format = "Input format: <input file> <output file> <requested width> <requested height> <dx> <dy> <gamma> <scale> [<B> <C>]";
-	if ((argc != 9) && (argc != 11)) {
+	std::string const input_format = "Input format: <input file> <output file> <requested width> <requested height> <dx> <dy> <gamma> <scale> [<B> <C>]\n"
+		"          or: --batch <manifest or directory> <output directory> [-j <threads>] <requested width> <requested height> <dx> <dy> <gamma> <scale> [<B> <C>]";
+	bool batch_mode = is_batch(argc, argv);
+	batch_options batch;
+	int first_arg = 3;
+	try {
+		if (batch_mode) {
+			batch = parse_batch(argc, argv);
+			first_arg = batch.first_arg;
+		}
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	int num_args = argc - (first_arg - 3);
+	char** args = argv + first_arg - 3;
+	if ((num_args != 9) && (num_args != 11)) {
 		std::cerr << input_format << std::endl;
 		return 1;
 	}
@@ -37,41 +55,45 @@ int main(int argc, char* argv[]) {
 	double dy;
 	double gamma;
 	try {
-		new_w = get_valid_number<uint32_t>(argv[3], get_uint32_t, "requested w", "positive integer");
+		new_w = get_valid_number<uint32_t>(args[3], get_uint32_t, "requested w", "positive integer");
 		if (new_w == 0) throw std::runtime_error("Requested w should be positive integer");
-		new_h = get_valid_number<uint32_t>(argv[4], get_uint32_t, "requested h", "positive integer");
+		new_h = get_valid_number<uint32_t>(args[4], get_uint32_t, "requested h", "positive integer");
 		if (new_h == 0) throw std::runtime_error("Requested h should be positive integer");
-		dx = get_valid_number<double>(argv[5], get_double, "dx", "double");
-		dy = get_valid_number<double>(argv[6], get_double, "dy", "double");
-		gamma = get_valid_number<double>(argv[7], get_double, "gamma", "double");
+		dx = get_valid_number<double>(args[5], get_double, "dx", "double");
+		dy = get_valid_number<double>(args[6], get_double, "dy", "double");
+		gamma = get_valid_number<double>(args[7], get_double, "gamma", "double");
 		if (gamma < 0) throw std::runtime_error("gamma should be non-negative integer");
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
 	}
-	if (argv[8][1] != '\0') {
+	if (args[8][1] != '\0') {
 		std::cerr << "scale should be from 0 to 3" << std::endl;
 		return 1;
 	}
 	double B = 0;
 	double C = 0.5;
-	if ((argc == 11) && (argv[8][0] != '3')) {
+	if ((num_args == 11) && (args[8][0] != '3')) {
 		std::cerr << "B and C are valid only for BC-spline" << std::endl;
 		return 1;
 	}
-	if (argc == 11) {
+	if (num_args == 11) {
 		try {
-			B = get_valid_number<double>(argv[9], get_double, "B", "double");
-			C = get_valid_number<double>(argv[10], get_double, "C", "double");
+			B = get_valid_number<double>(args[9], get_double, "B", "double");
+			C = get_valid_number<double>(args[10], get_double, "C", "double");
 		} catch (std::exception &e) {
 			std::cerr << e.what() << std::endl;
 			return 1;
 		}
 	}
+	auto process = [&](std::string const& input, std::string const& output) {
+		pnm_image image(input);
+		image.convert(new_w, new_h, dx, dy, gamma, args[8][0], B, C);
+		image.print_to_file(output);
+	};
 	try {
-		pnm_image image(argv[1]);
-		image.convert(new_w, new_h, dx, dy, gamma, argv[8][0], B, C);
-		image.print_to_file(argv[2]);
+		if (batch_mode) return run_batch(batch, "", process) == 0 ? 0 : 1;
+		process(argv[1], argv[2]);
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
@@ -5,57 +5,54 @@
 
 #include "pnm_image.h"
 
-static uint32_t get_number(const char* s) {
-	char const* cur = s;
-	if (*cur == '\0') throw std::runtime_error("Incorrect format of file");
-	while (*cur != '\0') {
-		if (!std::isdigit(*cur)) throw std::runtime_error("Incorrect format of file");
-		cur++;
-	}
-	uint32_t num = std::stoul(s);
-	if (num == 0) throw std::runtime_error("Incorrect format of file");
-	return num;
-}
+namespace lab4 {
 
 pnm_image::pnm_image(std::string const& filename) {
-	std::ifstream input(filename, std::ios_base::binary);
-	if (input.fail()) throw std::runtime_error("Could not open input file");
-	char input_str[128];
-	input.get(input_str, 128, '\n');
-	if (strcmp(input_str, "P5") == 0) {
-		type = 1;
-	} else if (strcmp(input_str, "P6") == 0) {
-		type = 3;
-	} else {
-		throw std::runtime_error("Expected P5 or P6");
+	pnm_file file(filename);
+	pnm_header const& header = file.header();
+	type = header.type;
+	w = header.w;
+	h = header.h;
+	depth = header.depth;
+	size_t length = header.length();
+	try {
+		data = std::unique_ptr<double[]>(new double[length]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
 	}
-	input.ignore();
-	input.get(input_str, 128, ' ');
-	w = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	h = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	depth = get_number(input_str);
-	input.ignore();
-	size_t length = static_cast<size_t>(w) * h * type;
+	uint8_t const* pixels = file.pixels();
+	for (size_t i = 0; i < length; i++) data[i] = static_cast<double>(pixels[i]);
+}
+
+pnm_image::pnm_image(pnm_header const& header, uint8_t const* pixels) : type(header.type), w(header.w), h(header.h), depth(header.depth) {
+	size_t length = header.length();
 	try {
 		data = std::unique_ptr<double[]>(new double[length]);
 	} catch (...) {
 		throw std::runtime_error("Could not allocate memory");
 	}
-	std::unique_ptr<uint8_t[]> buffer;
+	for (size_t i = 0; i < length; i++) data[i] = static_cast<double>(pixels[i]);
+}
+
+pnm_header pnm_image::header() const {
+	pnm_header header;
+	header.type = type;
+	header.w = w;
+	header.h = h;
+	header.depth = depth;
+	return header;
+}
+
+std::unique_ptr<uint8_t[]> pnm_image::get_pixels() const {
+	size_t length = static_cast<size_t>(w) * h * type;
+	std::unique_ptr<uint8_t[]> pixels;
 	try {
-		buffer = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
+		pixels = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
 	} catch (...) {
 		throw std::runtime_error("Could not allocate memory");
 	}
-	input.read(reinterpret_cast<char*>(buffer.get()), length);
-	if (input.fail()) throw std::runtime_error("Incorrect format of file");
-	input.ignore();
-	if (!input.eof()) throw std::runtime_error("Incorrect format of file");
-	for (size_t i = 0; i < length; i++) data[i] = static_cast<double>(buffer[i]);
+	for (size_t i = 0; i < length; i++) pixels[i] = static_cast<uint8_t>(data[i]);
+	return pixels;
 }
 
 static double get_real(double y, double gamma) {
@@ -517,4 +514,6 @@ void pnm_image::print_to_file(std::string const& filename) {
 		std::remove(filename.c_str());
 		throw std::runtime_error("Could not write to the file");
 	}
+}
+
 }
\ No newline at end of file
@@ -1,13 +1,19 @@
-#ifndef PNM_IMAGE_H
-#define PNM_IMAGE_H
+#ifndef LAB4_PNM_IMAGE_H
+#define LAB4_PNM_IMAGE_H
 
 #include <memory>
 #include <cstdint>
 #include <string>
 
+#include "../common/pnm_io.h"
+
+namespace lab4 {
+
 struct pnm_image {
 	pnm_image(std::string const& filename);
 
+	pnm_image(pnm_header const& header, uint8_t const* pixels);
+
 	pnm_image(pnm_image const&) = delete;
 
 	pnm_image& operator=(pnm_image const&) = delete;
@@ -18,6 +24,10 @@ struct pnm_image {
 
 	void print_to_file(std::string const& filename);
 
+	pnm_header header() const;
+
+	std::unique_ptr<uint8_t[]> get_pixels() const;
+
 private:
 	std::unique_ptr<double[]> data;
 	uint32_t type;
@@ -33,4 +43,6 @@ private:
 	void bc_spline(uint32_t new_w, uint32_t new_h, double dx, double dy, double gamma, double B, double C);
 };
 
+}
+
 #endif
\ No newline at end of file
@@ -2,26 +2,51 @@
 #include <exception>
 #include <string>
 
+#include "../common/batch.h"
 #include "pgm_image.h"
 
+using lab5::pgm_image;
+
 int main(int argc, char* argv[]) {
-	if (argc != 4) {
-		std::cerr << "Input format: <input file> <output file> <num of classes>" << std::endl;
+	bool batch_mode = is_batch(argc, argv);
+	batch_options batch;
+	int first_arg = 3;
+	try {
+		if (batch_mode) {
+			batch = parse_batch(argc, argv);
+			first_arg = batch.first_arg;
+		}
+	} catch (std::exception const& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	if (argc != first_arg + 1 && argc != first_arg + 2) {
+		std::cerr << "Input format: <input file> <output file> <num of classes> [<band height>]" << std::endl;
+		std::cerr << "          or: --batch <manifest or directory> <output directory> [-j <threads>] <num of classes> [<band height>]" << std::endl;
 		return 1;
 	}
 	uint32_t classes;
 	try {
 		size_t index;
-		classes = std::stoull(argv[3], &index);
-		if (classes == 0 || argv[3][0] == '-' || argv[3][index] != '\0') throw std::runtime_error("");
+		classes = std::stoull(argv[first_arg], &index);
+		if (classes == 0 || argv[first_arg][0] == '-' || argv[first_arg][index] != '\0') throw std::runtime_error("");
 	} catch (...) {
 		std::cerr << "Number of classes should be a positive integer" << std::endl;
 		return 1;
 	}
 	try {
-		pgm_image image(argv[1]);
-		image.divide_into_classes(classes);
-		image.print_to_file(argv[2]);
+		size_t band_rows = (argc == first_arg + 2 ? get_band_rows(argv[first_arg + 1]) : 0);
+		auto process = [&](std::string const& input, std::string const& output) {
+			if (band_rows != 0) {
+				pgm_image::stream(input, output, classes, band_rows);
+				return;
+			}
+			pgm_image image(input);
+			image.divide_into_classes(classes);
+			image.print_to_file(output);
+		};
+		if (batch_mode) return run_batch(batch, "", process) == 0 ? 0 : 1;
+		process(argv[1], argv[2]);
 	} catch (std::exception const& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
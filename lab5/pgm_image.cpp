@@ -5,47 +5,26 @@
 #include <cstring>
 #include <vector>
 #include <cctype>
+#include <cmath>
+#include <algorithm>
 
 #include "pgm_image.h"
 
-static uint32_t get_number(char const* s) {
-	char const* cur = s;
-	if (*cur == '\0') throw std::runtime_error("Incorrect format of file");
-	while (*cur != '\0') {
-		if (!std::isdigit(*cur)) throw std::runtime_error("Incorrect format of file");
-		cur++;
-	}
-	uint32_t num = std::stoul(s);
-	if (num == 0) throw std::runtime_error("Incorrect format of file");
-	return num;
+namespace lab5 {
+
+pgm_image::pgm_image(std::string const& filename) : file(filename) {
+	pnm_header const& header = file.header();
+	if (header.type != 1) throw std::runtime_error("Incorrect P5 file");
+	w = header.w;
+	h = header.h;
+	depth = header.depth;
+	data = file.pixels();
 }
 
-pgm_image::pgm_image(std::string const& filename) {
-	std::ifstream input(filename, std::ios_base::binary);
-	if (input.fail()) throw std::runtime_error("Could not open input file");
-	char input_str[128];
-	input.get(input_str, 128, '\n');
-	if (strcmp(input_str, "P5") != 0) throw std::runtime_error("Incorrect P5 file");
-	input.ignore();
-	input.get(input_str, 128, ' ');
-	w = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	h = get_number(input_str);
-	input.ignore();
-	input.get(input_str, 128, '\n');
-	depth = get_number(input_str);
-	size_t length = static_cast<size_t>(w) * h;
-	try {
-		data = std::unique_ptr<uint8_t[]>(new uint8_t[length]);
-	} catch (...) {
-		throw std::runtime_error("Could not allocate memory");
-	}
-	input.ignore();
-	input.read(reinterpret_cast<char*>(data.get()), length);
-	if (input.fail()) throw std::runtime_error("Incorrect format of file");
-	input.ignore();
-	if (!input.eof()) throw std::runtime_error("Incorrect format of file");
+pgm_image::pgm_image(pnm_header const& header, std::unique_ptr<uint8_t[]> pixels)
+	: buffer(std::move(pixels)), w(header.w), h(header.h), depth(header.depth) {
+	if (header.type != 1) throw std::runtime_error("Incorrect P5 file");
+	data = buffer.get();
 }
 
 static bool get_next(bool(&arr)[256]) {
@@ -73,20 +52,12 @@ static bool get_next(bool(&arr)[256]) {
 	return false;
 }
 
-void pgm_image::divide_into_classes(uint32_t classes) {
+static void get_colors(double const (&p)[256], uint32_t classes, uint8_t (&right_color)[256]) {
 	classes = std::min(256u, classes - 1);
 	double ans = std::numeric_limits<double>::min();
 	bool ans_arr[256];
 	memset(ans_arr, 0, 256);
 	bool arr[256];
-	double p[256];
-	for (size_t i = 0; i < 256; i++) {
-		p[i] = 0;
-	}
-	size_t length = static_cast<size_t>(w) * h;
-	for (size_t i = 0; i < length; i++) {
-		p[data[i]] += 1.0 / length;
-	}
 	std::memset(arr, 1, classes);
 	std::memset(arr + classes, 0, 256 - classes);
 	do {
@@ -112,7 +83,6 @@ void pgm_image::divide_into_classes(uint32_t classes) {
 		}
 	} while (get_next(arr));
 	uint8_t cur_color = 0;
-	uint8_t right_color[256];
 	for (size_t i = 0, j = 0; i < 256; i++) {
 		right_color[i] = cur_color;
 		if (ans_arr[i]) {
@@ -120,21 +90,72 @@ void pgm_image::divide_into_classes(uint32_t classes) {
 			cur_color = 255 * j / classes;
 		}
 	}
+}
+
+void pgm_image::divide_into_classes(uint32_t classes) {
+	double p[256];
+	for (size_t i = 0; i < 256; i++) {
+		p[i] = 0;
+	}
+	size_t length = static_cast<size_t>(w) * h;
+	for (size_t i = 0; i < length; i++) {
+		p[data[i]] += 1.0 / length;
+	}
+	uint8_t right_color[256];
+	get_colors(p, classes, right_color);
 	for (size_t i = 0; i < length; i++) {
 		data[i] = right_color[data[i]];
 	}
 }
 
-void pgm_image::print_to_file(std::string const& filename) {
-	std::ofstream output(filename, std::ios_base::binary);
-	if (!output.is_open()) throw std::runtime_error("Could not open file for writing");
-	output << "P5\n";
-	output << w << " " << h << "\n";
-	output << depth << "\n";
-	output.write(reinterpret_cast<char*>(data.get()), static_cast<size_t>(w) * h);
-	if (output.fail()) {
-		output.close();
-		std::remove(filename.c_str());
-		throw std::runtime_error("Could not write to the file");
+static std::unique_ptr<uint8_t[]> open_band(pnm_reader const& input, size_t& band_rows) {
+	pnm_header const& header = input.header();
+	if (header.type != 1) throw std::runtime_error("Incorrect P5 file");
+	band_rows = std::min<size_t>(band_rows, header.h);
+	try {
+		return std::unique_ptr<uint8_t[]>(new uint8_t[band_rows * header.w]);
+	} catch (...) {
+		throw std::runtime_error("Could not allocate memory");
 	}
+}
+
+void pgm_image::stream(std::string const& input_filename, std::string const& filename, uint32_t classes, size_t band_rows) {
+	double p[256];
+	for (size_t i = 0; i < 256; i++) {
+		p[i] = 0;
+	}
+	size_t rows;
+	{
+		pnm_reader input(input_filename);
+		std::unique_ptr<uint8_t[]> band = open_band(input, band_rows);
+		size_t length = input.header().length();
+		while ((rows = input.read_rows(band.get(), band_rows)) != 0) {
+			for (size_t i = 0; i < rows * input.header().w; i++) {
+				p[band[i]] += 1.0 / length;
+			}
+		}
+	}
+	uint8_t right_color[256];
+	get_colors(p, classes, right_color);
+	pnm_reader input(input_filename);
+	std::unique_ptr<uint8_t[]> band = open_band(input, band_rows);
+	pnm_writer output(filename, input.header());
+	while ((rows = input.read_rows(band.get(), band_rows)) != 0) {
+		for (size_t i = 0; i < rows * input.header().w; i++) {
+			band[i] = right_color[band[i]];
+		}
+		output.write_rows(band.get(), rows);
+	}
+	output.close();
+}
+
+void pgm_image::print_to_file(std::string const& filename) {
+	pnm_header header;
+	header.type = 1;
+	header.w = w;
+	header.h = h;
+	header.depth = depth;
+	write_pnm(filename, header, data);
+}
+
 }
\ No newline at end of file
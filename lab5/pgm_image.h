@@ -1,21 +1,34 @@
-#ifndef PGM_IMAGE_H
-#define PGM_IMAGE_H
+#ifndef LAB5_PGM_IMAGE_H
+#define LAB5_PGM_IMAGE_H
 
 #include <memory>
 #include <cstdint>
 #include <string>
 
+#include "../common/pnm_io.h"
+
+namespace lab5 {
+
 struct pgm_image {
 	pgm_image(std::string const& filename);
 
+	pgm_image(pnm_header const& header, std::unique_ptr<uint8_t[]> pixels);
+
 	void divide_into_classes(uint32_t const classes);
 
 	void print_to_file(std::string const& filename);
 
+	// Two passes over the input (histogram, then thresholds) holding only band_rows rows at a time.
+	static void stream(std::string const& input_filename, std::string const& filename, uint32_t classes, size_t band_rows);
+
 private:
-	std::unique_ptr<uint8_t[]> data;
+	pnm_file file;
+	std::unique_ptr<uint8_t[]> buffer;
+	uint8_t* data;
 	uint32_t w, h;
 	uint16_t depth;
 };
 
+}
+
 #endif
\ No newline at end of file
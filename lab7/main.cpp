@@ -1,13 +1,24 @@
 #include <iostream>
 #include <exception>
 
+#include "../common/batch.h"
 #include "pnm_image.h"
 
+using lab7::pnm_image;
+
 int main(int argc, char* argv[]) {
 	try {
+		auto process = [](std::string const& input, std::string const& output) {
+			pnm_image image(input);
+			image.print_to_file(output);
+		};
+		if (is_batch(argc, argv)) {
+			batch_options batch = parse_batch(argc, argv);
+			if (argc != batch.first_arg) throw std::runtime_error("Batch format: --batch <manifest or directory> <output directory> [-j <threads>]");
+			return run_batch(batch, ".pnm", process) == 0 ? 0 : 1;
+		}
 		if (argc != 3) throw std::runtime_error("Input format: <input png file> <output pnm file>");
-		pnm_image image(argv[1]);
-		image.print_to_file(argv[2]);
+		process(argv[1], argv[2]);
 	} catch (std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
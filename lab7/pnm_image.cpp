@@ -7,6 +7,8 @@
 #include "zlib/zlib.h"
 #include "pnm_image.h"
 
+namespace lab7 {
+
 static uint32_t read_be(void* buf) {
 	uint8_t* num = reinterpret_cast<uint8_t*>(buf);
 	return 16'777'216u * num[0] + 65'536u * num[1] + 256u * num[2] + num[3];
@@ -225,4 +227,6 @@ void pnm_image::inflate() {
 		} while (stream.avail_out == 0);
 	} while (ret != Z_STREAM_END);
 	inflateEnd(&stream);
+}
+
 }
\ No newline at end of file
@@ -1,11 +1,13 @@
-#ifndef PNM_IMAGE_H
-#define PNM_IMAGE_H
+#ifndef LAB7_PNM_IMAGE_H
+#define LAB7_PNM_IMAGE_H
 
 #include <vector>
 #include <cstdint>
 #include <string>
 #include <fstream>
 
+namespace lab7 {
+
 struct pnm_image {
 	pnm_image(std::string const& filename);
 
@@ -33,4 +35,6 @@ private:
 	void inflate();
 };
 
+}
+
 #endif
\ No newline at end of file
@@ -6,6 +6,8 @@
 
 #include "pnm_image.h"
 
+namespace lab8 {
+
 double const PI = 3.1415926535;
 
 struct pnm_image::huffman_tree {
@@ -130,8 +132,6 @@ void pnm_image::decode_frame() {
 	uint8_t quantization_number = raw_data[pos++];
 }
 
-#include <iostream>
-
 void pnm_image::decode_scan() {
 	size_t len = read_be();
 	pos += len - 2;
@@ -311,4 +311,6 @@ void pnm_image::print_to_file(std::string const& filename) {
 		std::remove(filename.c_str());
 		throw std::runtime_error("Could not write to the file");
 	}
+}
+
 }
\ No newline at end of file
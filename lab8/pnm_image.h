@@ -1,5 +1,5 @@
-#ifndef PNM_IMAGE_H
-#define PNM_IMAGE_H
+#ifndef LAB8_PNM_IMAGE_H
+#define LAB8_PNM_IMAGE_H
 
 #include <vector>
 #include <cstdint>
@@ -7,6 +7,8 @@
 #include <fstream>
 #include <map>
 
+namespace lab8 {
+
 struct pnm_image {
 	pnm_image(std::string const& filename);
 
@@ -50,4 +52,6 @@ private:
 	void get_matrix(size_t x, size_t y, int32_t &old_value, std::vector<uint8_t> &encoded_image, size_t &p);
 };
 
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#include "../common/pnm_io.h"
+#include "../lab1/ppm_image.h"
+#include "../lab2/pnm_image.h"
+#include "../lab3/pgm_image.h"
+#include "../lab4/pnm_image.h"
+
+// Runs the lab1 -> lab2 -> lab4 -> lab3 kernels in one process, the image is
+// handed from stage to stage in memory instead of through intermediate files.
+
+struct stage {
+	char kind;
+	char operation = 0;
+	std::string initial_model, final_model;
+	uint32_t new_w = 0, new_h = 0;
+	double dx = 0, dy = 0, gamma = 0;
+	double B = 0, C = 0.5;
+	uint8_t num_bits = 0;
+	uint8_t dither_type = 0;
+};
+
+struct image_state {
+	pnm_file file;
+	pnm_header header;
+	std::unique_ptr<uint8_t[]> pixels;
+
+	uint8_t const* view() const {
+		return pixels ? pixels.get() : file.pixels();
+	}
+
+	std::unique_ptr<uint8_t[]> take() {
+		if (!pixels) {
+			try {
+				pixels = std::unique_ptr<uint8_t[]>(new uint8_t[header.length()]);
+			} catch (...) {
+				throw std::runtime_error("Could not allocate memory");
+			}
+			memcpy(pixels.get(), file.pixels(), header.length());
+			file = pnm_file();
+		}
+		return std::move(pixels);
+	}
+};
+
+template<typename T>
+T get_valid_number(char const* arg, T(*to_number)(char const*, size_t*), std::string const& var_name, std::string const& type_name) {
+	try {
+		size_t index;
+		T ans = to_number(arg, &index);
+		if (arg[index] != '\0') throw std::runtime_error("");
+		return ans;
+	} catch (...) {
+		throw std::runtime_error("Invalid " + var_name + ", expected valid " + type_name + " number");
+	}
+}
+
+uint32_t get_uint32_t(char const* arg, size_t* index) {
+	if (arg[0] == '-') throw std::runtime_error("Requested width of height should be positive integer");
+	return std::stoul(arg, index);
+}
+
+double get_double(char const* arg, size_t* index) {
+	return std::stod(arg, index);
+}
+
+static bool is_stage(char const* arg) {
+	return strcmp(arg, "orient") == 0 || strcmp(arg, "convert") == 0 || strcmp(arg, "resize") == 0 || strcmp(arg, "dither") == 0;
+}
+
+static std::vector<stage> parse_stages(int argc, char* argv[]) {
+	std::vector<stage> stages;
+	int cur = 3;
+	auto need = [&](int count) {
+		if (cur + count >= argc) throw std::runtime_error(std::string("Not enough arguments for stage ") + argv[cur]);
+	};
+	while (cur < argc) {
+		stage s;
+		if (strcmp(argv[cur], "orient") == 0) {
+			need(1);
+			s.kind = 'o';
+			s.operation = argv[cur + 1][0];
+			if (s.operation < '0' || s.operation > '4' || argv[cur + 1][1] != '\0') throw std::runtime_error("Orientation should be from 0 to 4");
+			cur += 2;
+		} else if (strcmp(argv[cur], "convert") == 0) {
+			need(2);
+			s.kind = 'c';
+			s.initial_model = argv[cur + 1];
+			s.final_model = argv[cur + 2];
+			cur += 3;
+		} else if (strcmp(argv[cur], "resize") == 0) {
+			need(6);
+			s.kind = 'r';
+			s.new_w = get_valid_number<uint32_t>(argv[cur + 1], get_uint32_t, "requested w", "positive integer");
+			if (s.new_w == 0) throw std::runtime_error("Requested w should be positive integer");
+			s.new_h = get_valid_number<uint32_t>(argv[cur + 2], get_uint32_t, "requested h", "positive integer");
+			if (s.new_h == 0) throw std::runtime_error("Requested h should be positive integer");
+			s.dx = get_valid_number<double>(argv[cur + 3], get_double, "dx", "double");
+			s.dy = get_valid_number<double>(argv[cur + 4], get_double, "dy", "double");
+			s.gamma = get_valid_number<double>(argv[cur + 5], get_double, "gamma", "double");
+			if (s.gamma < 0) throw std::runtime_error("gamma should be non-negative integer");
+			s.operation = argv[cur + 6][0];
+			if (s.operation < '0' || s.operation > '3' || argv[cur + 6][1] != '\0') throw std::runtime_error("scale should be from 0 to 3");
+			cur += 7;
+			if (s.operation == '3' && cur + 1 < argc && !is_stage(argv[cur])) {
+				s.B = get_valid_number<double>(argv[cur], get_double, "B", "double");
+				s.C = get_valid_number<double>(argv[cur + 1], get_double, "C", "double");
+				cur += 2;
+			}
+		} else if (strcmp(argv[cur], "dither") == 0) {
+			need(3);
+			s.kind = 'd';
+			s.dither_type = lab3::parse_dither(argv[cur + 1]);
+			if (argv[cur + 2][0] < '1' || argv[cur + 2][0] > '8' || argv[cur + 2][1] != '\0') throw std::runtime_error("num of bits should be from 1 to 8");
+			s.num_bits = argv[cur + 2][0] - '0';
+			s.gamma = get_valid_number<double>(argv[cur + 3], get_double, "gamma", "double");
+			cur += 4;
+		} else {
+			throw std::runtime_error(std::string("Unknown stage ") + argv[cur]);
+		}
+		stages.push_back(s);
+	}
+	if (stages.empty()) throw std::runtime_error("Expected at least one stage");
+	return stages;
+}
+
+static void run_stage(stage const& s, image_state& image) {
+	switch (s.kind) {
+	case 'o': {
+		lab1::ppm_image stage_image(image.header, image.take());
+		switch (s.operation) {
+		case '0':
+			stage_image.invert();
+			break;
+		case '1':
+			stage_image.flip_horizontally();
+			break;
+		case '2':
+			stage_image.flip_vertically();
+			break;
+		case '3':
+			stage_image.rotate_90_clockwise();
+			break;
+		case '4':
+			stage_image.rotate_90_counter_clockwise();
+			break;
+		}
+		image.header = stage_image.header();
+		image.pixels = stage_image.release();
+		break;
+	}
+	case 'c': {
+		lab2::pnm_image stage_image(image.header, image.take(), s.initial_model);
+		stage_image.convert(s.final_model);
+		image.header = stage_image.header();
+		image.pixels = stage_image.release();
+		break;
+	}
+	case 'r': {
+		lab4::pnm_image stage_image(image.header, image.view());
+		stage_image.convert(s.new_w, s.new_h, s.dx, s.dy, s.gamma, s.operation, s.B, s.C);
+		image.header = stage_image.header();
+		image.pixels = stage_image.get_pixels();
+		break;
+	}
+	case 'd': {
+		lab3::pgm_image stage_image(image.header, image.view());
+		stage_image.dither(s.dither_type, s.num_bits, s.gamma);
+		image.header = stage_image.header();
+		image.pixels = stage_image.get_pixels();
+		break;
+	}
+	}
+	image.file = pnm_file();
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 4) {
+		std::cerr << "Input format: <input file> <output file> <stage> [<stage> ...]" << std::endl;
+		std::cerr << "Stages: orient <type of operation>" << std::endl;
+		std::cerr << "        convert <initial color model> <final color model>" << std::endl;
+		std::cerr << "        resize <requested width> <requested height> <dx> <dy> <gamma> <scale> [<B> <C>]" << std::endl;
+		std::cerr << "        dither <dithering> <bit> <gamma>" << std::endl;
+		return 1;
+	}
+	try {
+		std::vector<stage> stages = parse_stages(argc, argv);
+		image_state image;
+		image.file = pnm_file(argv[1]);
+		image.header = image.file.header();
+		for (stage const& s : stages) {
+			run_stage(s, image);
+		}
+		write_pnm(argv[2], image.header, image.view());
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
\ No newline at end of file